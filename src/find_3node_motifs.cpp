@@ -5,56 +5,220 @@
 
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
 #include <fstream>
 #include <iostream>
-#include <iterator>
 #include <map>
-#include <set>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+#include "motif_instances.hpp"
+#include "motif_search.hpp"
+#include "output_writer.hpp"
+#include "triads.hpp"
+
 
 namespace {
-  typedef std::map< std::string, std::set<std::string> > NetworkType;
-  typedef NetworkType BidirEdges;
-  typedef NetworkType UniEdges;
+  using namespace network_motifs;
+
+  //==========
+  // RunStats
+  //==========
+  // Timings and counters for --stats.  The set operations of a thread tally
+  //  into a SetOpCounts of its own only while --stats is on, and so do its
+  //  tasks into pass timings of its own, so tasks take no lock.
+  struct Input;
+
+  class RunStats {
+  public:
+    // "-" reports to stderr as text, any other path gets the report as JSON
+    explicit RunStats(const std::string& path);
+
+    // seconds since construction
+    double Now() const;
+    // the phase that ran since the last one ended
+    void Phase(const std::string& name);
+    // the number of each pass, by name, for Task(); called before a run of
+    //  tasks on 'threads' threads begins
+    std::vector<std::size_t> Passes(const std::vector<std::string>& names, unsigned int threads);
+    // one task of pass number 'pass' on thread 'worker': when it ran, its
+    //  thread's CPU time and instances found
+    void Task(unsigned int worker, std::size_t pass, double start, double end, double cpu, Count instances) {
+      Timing& t = tasks_[worker][pass];
+      t.first = t.tasks ? std::min(t.first, start) : start;
+      t.last = t.tasks ? std::max(t.last, end) : end;
+      t.cpu += cpu;
+      ++t.tasks;
+      t.instances += instances;
+    }
+    // a progress line on stderr now and then, once 'done' of 'total' tasks that
+    //  began at 'since' are finished
+    void Progress(std::size_t done, std::size_t total, double since);
+    void Add(const SetOpCounts& counts);
+    void Report(const Input& input) const;
 
-  struct ByLine : public std::string {
-    friend std::istream& operator>>(std::istream& is, ByLine& b) {
-      std::getline(is, b);
-      return(is);
+  private:
+    struct Timing {
+      std::string name;
+      double wall, cpu;
+      double first, last; // of a pass's tasks
+      std::size_t tasks;
+      Count instances;
+    };
+
+    std::string path_;
+    std::chrono::steady_clock::time_point origin_;
+    double phaseWall_, phaseCpu_; // when the current phase began
+    std::atomic<double> lastProgress_;
+    std::vector<Timing> phases_;
+    std::vector<std::string> passes_;
+    std::vector< std::vector<Timing> > tasks_; // by thread, then pass
+    SetOpCounts setOps_;
+    mutable std::mutex lock_;
+  };
+
+  // Counts the set operations of the thread it lives on into stats, if any
+  struct CountSetOps {
+    explicit CountSetOps(RunStats* stats) : stats_(stats) {
+      std::memset(&counts_, 0, sizeof(counts_));
+      if ( stats_ )
+        set_op_counts() = &counts_;
+    }
+    ~CountSetOps() {
+      if ( stats_ ) {
+        set_op_counts() = nullptr;
+        stats_->Add(counts_);
+      }
     }
+
+  private:
+    RunStats* stats_;
+    SetOpCounts counts_;
   };
 
   struct Help {};
+  struct GraphHeader;
 
-  struct Input {
+  // The graph given on the command line, and how to search it
+  struct Input : Graph {
     Input(int argc, char** argv);
 
-    const BidirEdges& AllBidirectionalEdges() const { return allBis_; }
-    const BidirEdges& BidirectionalEdges() const { return bis_; }
-    const UniEdges& UnidirectionalInputEdges() const { return ins_; }
-    const UniEdges& UnidirectionalOutputEdges() const { return outs_; }
+    // A graph over the nodes of 'model' with unidirectional edges 'uni' and
+    //  bidirectional edges 'mutual' (each listed once), for one thread and
+    //  without labels; the vectors are used up
+    Input(const Input& model, std::vector<Edge>& uni, std::vector<Edge>& mutual);
+
+    bool CountsOnly() const { return countsOnly_; }
+    unsigned int Threads() const { return threads_; }
+    bool SinglePass() const { return singlePass_; }
+    bool DegreeOrder() const { return degreeOrder_; }
+    bool Binary() const { return binary_; }
+    bool Roles() const { return roles_; }
+    bool Estimate() const { return estimate_; }
+    double Seconds() const { return seconds_; }
+    double RelativeError() const { return error_; }
+    std::size_t Top() const { return top_; }
+    const std::string& Edits() const { return edits_; }
+    const std::string& Seeds() const { return seeds_; }
+    bool AllSeeds() const { return allSeeds_; }
+    std::size_t Replicates() const { return replicates_; }
+    unsigned long SwapsPerEdge() const { return swaps_; }
+    unsigned long Seed() const { return seed_; }
+    bool ReportMemory() const { return reportMemory_; }
+    // null without --stats
+    RunStats* Stats() const { return stats_.get(); }
+    std::string MemoryReport() const;
 
     static std::string Usage() {
-      std::string msg = "find_3node_motifs <input-graph>";
+      std::string msg = "find_3node_motifs [--counts | --binary | --roles [--top <K>]] [--single-pass | --degree-order] [--threads <N>]\n"
+                        "                  [--hub-degree <N>] [--random <N> [--swaps <K>] | --edits <file> | --estimate [--seconds <T>] [--error <E>]]\n"
+                        "                  [--seed <S>] [--seeds <file> [--all-seeds]]\n"
+                        "                  [--save-graph <cache> | --load-graph <cache>] [--memory-limit <MB>] [--stats <file>]\n"
+                        "                  <input-graph>";
       msg += "\n\n  <input-graph> is a file with rows that look like:\nA   B\n  where a tab separates the node labels and A->B in your graph";
+      msg += "\n\n  --counts reports how many instances of each motif type exist instead of listing them";
+      msg += "\n  --binary lists instances in the binary format read by motif3_network_changes";
+      msg += "\n  --roles reports, for each node, how many motifs of each type it is in and in which role,\n    the role being its place in the listed instances (e.g. FFL-Source, FFL-Middle, FFL-Sink)\n    instead of listing them.  With --top <K>, only the K nodes with the most motifs in each\n    role are reported";
+      msg += "\n  --single-pass finds all motif types in one sweep over the graph; the same instances are\n    listed, but in the order they are found rather than grouped by type";
+      msg += "\n  --degree-order also finds all motif types in one sweep, with nodes ranked by degree so\n    that each triple is found from its lowest-ranked node and hubs are not searched from.\n    The same instances are listed, with the same node order, but in the order found.\n    Not with --roles, --random, --edits or --estimate";
+      msg += "\n  --threads <N> spreads the search over N threads (default 1); output is the same for any N";
+      msg += "\n  --hub-degree <N> keeps a bitset row for each node with at least N neighbors (0 for none).\n    The default is the larger of 64 and 1/32 of the number of nodes, where a row is no\n    bigger than the neighbor lists.  Adjacency memory use is reported on stderr whenever\n    rows are built, and always with --hub-degree.";
+      msg += "\n  --random <N> compares the motif counts with those of N random graphs where every node keeps\n    its numbers of unidirectional in- and out-edges and of bidirectional edges: reports\n    each type's observed count, mean and standard deviation over the random graphs,\n    and z-score.  Each random graph gets <K> edge switches per edge (--swaps, default\n    10) from a random stream set by --seed <S> (default 1); results do not depend on\n    --threads, which runs random graphs in parallel";
+      msg += "\n  --estimate reports an estimate of each motif type's count with a 95% confidence interval,\n    and its share of all motifs, from triples sampled at random (seeded by --seed) over\n    --threads.  Sampling stops after <T> seconds (--seconds) or once every type that is\n    at least a fraction <E> of the sampled triples is known to within <E> of its count\n    (--error); the default is --error 0.01.  With --error only, results do not depend\n    on --threads";
+      msg += "\n  --edits <file> applies rows of '+A<tab>B' (add A->B) or '-A<tab>B' (remove A->B) to the\n    graph, in order, and after each reports the motif instances that appeared, disappeared\n    or changed type; use - to read stdin.  With --counts, the census after the last edit\n    is reported instead";
+      msg += "\n  --seeds <file> lists only the motifs holding at least one of the node labels in <file>,\n    one per row (- for stdin), or with --all-seeds only those whose nodes are all in it.\n    Only the seeds' neighbors and their neighbors are searched, so this is fast on a\n    large graph, especially with --load-graph.  Motifs are listed in the order they are\n    found around each seed rather than grouped by type.  Labels not in the graph are\n    counted on stderr.  Not with --single-pass, --degree-order, --roles, --random, --edits or --estimate";
+      msg += "\n  --save-graph <cache> also writes the parsed graph to a binary cache file";
+      msg += "\n  --load-graph <cache> maps the graph from a cache written by --save-graph instead of\n    parsing <input-graph>, which must be the same file the cache was made from";
+      msg += "\n  --memory-limit <MB> builds the graph in node blocks kept in files under $TMPDIR (default\n    /tmp), holding the working memory to about <MB> beyond the node labels, and then maps\n    it as --load-graph does; output is the same.  The limit bounds the build only: the\n    search pages in whatever of the mapped graph it reads.  Not with --random or --edits";
+      msg += "\n  --stats <file> reports wall and CPU time by phase and by motif pass, set operations and\n    the list elements they were given, instances found, peak memory and the degrees of\n    the busiest nodes, to <file> as JSON or to stderr with -.  Runs of tasks also get a\n    progress line with an estimate of the time left on stderr every 10 seconds";
       return msg;
     }
 
   private:
-    BidirEdges allBis_;
-    BidirEdges bis_;
-    UniEdges outs_;
-    UniEdges ins_;
+    void BuildHubs();
+    void ReadOutOfCore(const MappedFile& file, const std::string& savePath);
+    GraphHeader Header(const MappedFile& source, const std::uint64_t numEdges[4]) const;
+    void SaveGraph(const std::string& path, const MappedFile& source) const;
+    void LoadGraph(const std::string& path, const std::string& source);
+    void MapGraph(const std::string& path);
+
+    bool countsOnly_;
+    bool singlePass_;
+    bool degreeOrder_;
+    bool allSeeds_;
+    bool binary_;
+    bool roles_;
+    bool estimate_;
+    bool reportMemory_;
+    std::size_t top_; // nodes per role for --top, 0 for all
+    std::size_t memoryLimit_; // bytes, 0 for none
+    double seconds_; // --estimate time budget, 0 for none
+    double error_; // --estimate relative error target, 0 for none
+    std::size_t replicates_; // random graphs for --random
+    unsigned long swaps_;
+    unsigned long seed_;
+    unsigned int threads_;
+    long hubDegree_; // < 0 for the default
+    std::string inputPath_;
+    std::string edits_; // from --edits
+    std::string seeds_; // from --seeds
+    std::unique_ptr<MappedFile> cache_; // from --load-graph
+    std::unique_ptr<RunStats> stats_;
   };
 
   void find_motifs(const Input& input);
+  void motif_census(const Input& input);
+  void null_model(const Input& input);
+  void apply_edits(const Input& input);
+  void motif_roles(const Input& input);
+  void estimate_motifs(const Input& input);
 } // unnamed
 
 
@@ -64,7 +228,32 @@ namespace {
 int main(int argc, char** argv) {
   try {
     Input input(argc, argv);
-    find_motifs(input);
+    if ( input.ReportMemory() )
+      std::cerr << input.MemoryReport() << std::endl;
+    std::string phase;
+    if ( input.Replicates() ) {
+      null_model(input);
+      phase = "random";
+    } else if ( !input.Edits().empty() ) {
+      apply_edits(input);
+      phase = "edits";
+    } else if ( input.Roles() ) {
+      motif_roles(input);
+      phase = "roles";
+    } else if ( input.Estimate() ) {
+      estimate_motifs(input);
+      phase = "estimate";
+    } else if ( input.CountsOnly() ) {
+      motif_census(input);
+      phase = "counts";
+    } else {
+      find_motifs(input);
+      phase = "list";
+    }
+    if ( input.Stats() ) {
+      input.Stats()->Phase(phase);
+      input.Stats()->Report(input);
+    }
     return EXIT_SUCCESS;
   } catch(Help& h) {
     std::cout << Input::Usage() << std::endl;
@@ -81,423 +270,1916 @@ int main(int argc, char** argv) {
 
 
 namespace {
-  void ffl(const Input& input) {
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    for ( auto& p : unidirOutEdges ) {
-      for ( auto& v : p.second ) {
-        auto w = unidirOutEdges.find(v);
-        if ( w != unidirOutEdges.end() ) {
-          // Print node with two outgoing edges in FFL, then edge with 1 in and 1 out, then the sink
-          std::vector<std::string> z;
-          std::set_intersection(p.second.begin(), p.second.end(),
-                                w->second.begin(), w->second.end(),
-                                std::back_inserter(z));
-          for ( auto& zout : z )
-            std::cout << "FFL:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
-        }
+  // The printed motif instances of one task.  When the text grows past Limit,
+  //  Spill() is called to write it out before the task goes on.
+  struct Output {
+    static const std::size_t Limit = 1 << 22;
+    std::string text;
+    std::function<void()> Spill;
+  };
+
+  // "FFL:\t" and so on, with lengths known up front
+  struct Prefixes {
+    Prefixes() {
+      for ( int m = 0; m < NumberOfMotifTypes; ++m )
+        text[m] = std::string(MotifNames[m]) + ":\t";
+    }
+    std::string text[NumberOfMotifTypes];
+  };
+
+  // Append one motif instance to out
+  void print(const Input& input, Output* out, MotifType type, Node a, Node b, Node c) {
+    static const Prefixes prefixes;
+    std::string& text = out->text;
+    if ( input.Binary() ) {
+      const network_motifs::InstanceRecord record = { static_cast<std::uint32_t>(type), { a, b, c } };
+      text.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    } else {
+      const Labels& labels = input.NodeLabels();
+      text.append(prefixes.text[type]); text.append(labels.Data(a), labels.Length(a));
+      text.push_back('\t'); text.append(labels.Data(b), labels.Length(b));
+      text.push_back('\t'); text.append(labels.Data(c), labels.Length(c));
+      text.push_back('\n');
+    }
+    if ( text.size() >= Output::Limit )
+      out->Spill();
+  }
+
+  //==========
+  // RunStats
+  //==========
+  double cpu_seconds(clockid_t clock) {
+    timespec t;
+    ::clock_gettime(clock, &t);
+    return static_cast<double>(t.tv_sec) + static_cast<double>(t.tv_nsec) * 1e-9;
+  }
+
+  inline double thread_cpu_seconds() { return cpu_seconds(CLOCK_THREAD_CPUTIME_ID); }
+
+  RunStats::RunStats(const std::string& path) : path_(path), origin_(std::chrono::steady_clock::now()), phaseWall_(0),
+                                                phaseCpu_(cpu_seconds(CLOCK_PROCESS_CPUTIME_ID)), lastProgress_(0) {
+    std::memset(&setOps_, 0, sizeof(setOps_));
+  }
+
+  double RunStats::Now() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin_).count();
+  }
+
+  void RunStats::Phase(const std::string& name) {
+    const double wall = Now(), cpu = cpu_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    std::lock_guard<std::mutex> guard(lock_);
+    const Timing t = { name, wall - phaseWall_, cpu - phaseCpu_, phaseWall_, wall, 0, 0 };
+    phases_.push_back(t);
+    phaseWall_ = wall;
+    phaseCpu_ = cpu;
+  }
+
+  std::vector<std::size_t> RunStats::Passes(const std::vector<std::string>& names, unsigned int threads) {
+    std::lock_guard<std::mutex> guard(lock_);
+    std::vector<std::size_t> numbers;
+    for ( auto& name : names ) {
+      const std::size_t p = std::find(passes_.begin(), passes_.end(), name) - passes_.begin();
+      if ( p == passes_.size() )
+        passes_.push_back(name);
+      numbers.push_back(p);
+    } // for
+    if ( tasks_.size() < threads )
+      tasks_.resize(threads);
+    const Timing none = { std::string(), 0, 0, 0, 0, 0, 0 };
+    for ( auto& t : tasks_ )
+      t.resize(passes_.size(), none);
+    return numbers;
+  }
+
+  void RunStats::Progress(std::size_t done, std::size_t total, double since) {
+    static const double Interval = 10; // seconds
+    const double now = Now();
+    double last = lastProgress_;
+    if ( now - last < Interval || done == 0 || done == total || !lastProgress_.compare_exchange_strong(last, now) )
+      return;
+    const double spent = now - since;
+    std::stringstream msg;
+    msg << std::fixed << std::setprecision(1) << "Progress: " << (100 * done / total) << "% of " << total
+        << " tasks after " << spent << " s, about " << spent * (total - done) / done << " s left";
+    std::cerr << msg.str() << std::endl;
+  }
+
+  void RunStats::Add(const SetOpCounts& counts) {
+    std::lock_guard<std::mutex> guard(lock_);
+    for ( int k = 0; k < NumberOfSetOpKinds; ++k ) {
+      setOps_.calls[k] += counts.calls[k];
+      setOps_.elements[k] += counts.elements[k];
+    } // for
+  }
+
+  // s as a JSON string
+  std::string json_string(const char* s, std::size_t n) {
+    std::string json("\"");
+    for ( std::size_t i = 0; i < n; ++i ) {
+      const unsigned char c = static_cast<unsigned char>(s[i]);
+      if ( c == '"' || c == '\\' ) {
+        json.push_back('\\');
+        json.push_back(static_cast<char>(c));
+      } else if ( c < 0x20 ) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        json.append(escaped);
+      } else
+        json.push_back(static_cast<char>(c));
+    } // for
+    return json + "\"";
+  }
+
+  void RunStats::Report(const Input& input) const {
+    std::lock_guard<std::mutex> guard(lock_);
+    static char const* const SetOpNames[NumberOfSetOpKinds] = { "intersections", "differences", "merges" };
+
+    // a pass's wall time runs from the start of its first task to the end of its last
+    std::vector<Timing> passes;
+    for ( std::size_t p = 0; p < passes_.size(); ++p ) {
+      Timing pass = { passes_[p], 0, 0, 0, 0, 0, 0 };
+      for ( auto& thread : tasks_ ) {
+        const Timing& t = thread[p];
+        if ( !t.tasks )
+          continue;
+        pass.first = pass.tasks ? std::min(pass.first, t.first) : t.first;
+        pass.last = pass.tasks ? std::max(pass.last, t.last) : t.last;
+        pass.cpu += t.cpu;
+        pass.tasks += t.tasks;
+        pass.instances += t.instances;
       } // for
+      pass.wall = pass.last - pass.first;
+      if ( pass.tasks )
+        passes.push_back(pass);
     } // for
+    Count instances = 0;
+    for ( auto& p : passes )
+      instances += p.instances;
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    const std::uint64_t peakRss = static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+
+    // the nodes with the most neighbors, whose work grows with its square, and
+    //  how many nodes have degrees 0, 1, 2-3, 4-7, ...
+    const Node numNodes = input.NumberOfNodes();
+    auto degree = [&input](Node n) {
+      return static_cast<Count>(input.UnidirectionalOutputEdges()[n].size() + input.UnidirectionalInputEdges()[n].size()
+                                + input.AllBidirectionalEdges()[n].size());
+    };
+    std::vector<Count> histogram;
+    for ( Node n = 0; n < numNodes; ++n ) {
+      Count d = degree(n);
+      std::size_t bucket = 0;
+      for ( ; d; d >>= 1 )
+        ++bucket;
+      if ( histogram.size() <= bucket )
+        histogram.resize(bucket + 1, 0);
+      ++histogram[bucket];
+    } // for
+    std::vector<Node> busiest(numNodes);
+    std::iota(busiest.begin(), busiest.end(), Node(0));
+    const std::size_t numBusiest = std::min<std::size_t>(10, numNodes);
+    std::partial_sort(busiest.begin(), busiest.begin() + numBusiest, busiest.end(), [&degree](Node a, Node b) {
+      return degree(a) > degree(b) || (degree(a) == degree(b) && a < b);
+    });
+    busiest.resize(numBusiest);
+    auto bucket_bounds = [](std::size_t b) {
+      std::stringstream range;
+      if ( b == 0 )
+        range << 0 << "\t" << 0;
+      else
+        range << (Count(1) << (b - 1)) << "\t" << ((Count(1) << b) - 1);
+      return range.str();
+    };
+
+    const Labels& labels = input.NodeLabels();
+    std::stringstream out;
+    out << std::setprecision(6);
+    if ( path_ == "-" ) {
+      for ( auto& p : phases_ )
+        out << "Phase\t" << p.name << "\twall\t" << p.wall << "\tcpu\t" << p.cpu << "\n";
+      for ( auto& p : passes ) {
+        out << "Pass\t" << p.name << "\twall\t" << p.wall << "\tcpu\t" << p.cpu << "\ttasks\t" << p.tasks
+            << "\tinstances\t" << p.instances << "\n";
+      } // for
+      for ( int k = 0; k < NumberOfSetOpKinds; ++k )
+        out << "Set operations\t" << SetOpNames[k] << "\t" << setOps_.calls[k] << "\telements\t" << setOps_.elements[k] << "\n";
+      out << "Instances\t" << instances << "\n";
+      out << "Peak RSS\t" << peakRss << "\n";
+      for ( auto n : busiest ) {
+        out << "Busiest node\t" << std::string(labels.Data(n), labels.Length(n)) << "\tout\t" << input.UnidirectionalOutputEdges()[n].size()
+            << "\tin\t" << input.UnidirectionalInputEdges()[n].size() << "\tmutual\t" << input.AllBidirectionalEdges()[n].size() << "\n";
+      } // for
+      for ( std::size_t b = 0; b < histogram.size(); ++b )
+        out << "Degree\t" << bucket_bounds(b) << "\tnodes\t" << histogram[b] << "\n";
+      std::cerr << out.str() << std::flush;
+      return;
+    }
+
+    auto timings = [&out](const char* name, const std::vector<Timing>& list, bool pass) {
+      out << " \"" << name << "\": [";
+      for ( std::size_t i = 0; i < list.size(); ++i ) {
+        const Timing& t = list[i];
+        out << (i ? ",\n   " : "\n   ") << "{\"name\": " << json_string(t.name.data(), t.name.size())
+            << ", \"wall_seconds\": " << t.wall << ", \"cpu_seconds\": " << t.cpu;
+        if ( pass )
+          out << ", \"tasks\": " << t.tasks << ", \"instances\": " << t.instances;
+        out << "}";
+      } // for
+      out << "],\n";
+    };
+    out << "{\n";
+    timings("phases", phases_, false);
+    timings("passes", passes, true);
+    out << " \"set_operations\": {";
+    for ( int k = 0; k < NumberOfSetOpKinds; ++k ) {
+      out << (k ? ", " : "") << "\"" << SetOpNames[k] << "\": {\"calls\": " << setOps_.calls[k]
+          << ", \"elements\": " << setOps_.elements[k] << "}";
+    } // for
+    out << "},\n \"instances\": " << instances << ",\n \"peak_rss_bytes\": " << peakRss << ",\n \"busiest_nodes\": [";
+    for ( std::size_t i = 0; i < busiest.size(); ++i ) {
+      const Node n = busiest[i];
+      out << (i ? ",\n   " : "\n   ") << "{\"node\": " << json_string(labels.Data(n), labels.Length(n))
+          << ", \"out\": " << input.UnidirectionalOutputEdges()[n].size() << ", \"in\": " << input.UnidirectionalInputEdges()[n].size()
+          << ", \"mutual\": " << input.AllBidirectionalEdges()[n].size() << "}";
+    } // for
+    out << "],\n \"degrees\": [";
+    for ( std::size_t b = 0; b < histogram.size(); ++b ) {
+      std::string range = bucket_bounds(b);
+      range.replace(range.find('\t'), 1, ", \"to\": ");
+      out << (b ? ",\n   " : "\n   ") << "{\"from\": " << range << ", \"nodes\": " << histogram[b] << "}";
+    } // for
+    out << "]\n}\n";
+
+    std::ofstream file(path_.c_str());
+    file << out.str();
+    if ( !file.flush() )
+      throw("Unable to write stats: " + path_);
   }
 
-  void tre_loop(const Input& input) {
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : unidirOutEdges ) {
-      auto k = unidirInEdges.find(p.first);
-      if ( k != unidirInEdges.end() ) {
-        for ( auto& v : p.second ) {
-          if ( v < p.first ) {
-            auto w = unidirOutEdges.find(v);
-            if ( w != unidirOutEdges.end() ) {
-              std::vector<std::string> z;
-
-              std::set_intersection(w->second.begin(), w->second.end(),
-                                    k->second.begin(), k->second.end(),
-                                    std::back_inserter(z));
-              for ( auto& zout : z ) {
-                if ( v < zout )
-                  std::cout << "3-Loop:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
-              } // for
-            }
+  //=======
+  // Sinks
+  //=======
+  // Prints each motif instance a search hands it into out
+  struct Printer {
+    void operator()(MotifType type, Node a, Node b, Node c) const { print(*input, out, type, a, b, c); }
+
+    const Input* input;
+    Output* out;
+  };
+
+  using network_motifs::triads::edge_bit;
+  using network_motifs::triads::Triad;
+  using network_motifs::triads::triad_code;
+  using network_motifs::triads::triadTable;
+
+  // Some motif search over a run of source nodes, adding what it finds to a
+  //  census; the name is for --stats.  Runs are cut at bounds when given,
+  //  else by chunk_bounds()
+  struct Pass {
+    std::string name;
+    std::function<void(Node, Node, Output*, Census&)> run;
+    std::vector<Node> bounds;
+  };
+
+  // One unit of work: a pass over a run of source nodes
+  struct Task {
+    const Pass* pass;
+    Node first, last;
+  };
+
+  //===========
+  // Scheduler
+  //===========
+  // Hands out task ids to a fixed set of workers.  Each worker owns a deque of
+  //  ids in ascending order and takes from its front; a worker whose deque is
+  //  empty steals from the back of another's.  Only ids below the commit window
+  //  are handed out, so buffered output stays bounded while earlier tasks finish.
+  struct Scheduler {
+    Scheduler(std::size_t numTasks, unsigned int numWorkers, std::size_t window)
+      : queues_(numWorkers), locks_(numWorkers), window_(window),
+        limit_(window), remaining_(numTasks) {
+      for ( std::size_t t = 0; t < numTasks; ++t )
+        queues_[t % numWorkers].push_back(t);
+    }
+
+    // false once every task has been handed out
+    bool Next(unsigned int worker, std::size_t& task) {
+      const std::size_t numWorkers = queues_.size();
+      while ( true ) {
+        const std::size_t limit = limit_.load();
+        for ( std::size_t i = 0; i < numWorkers; ++i ) {
+          const std::size_t victim = (worker + i) % numWorkers;
+          std::lock_guard<std::mutex> guard(locks_[victim]);
+          std::deque<std::size_t>& q = queues_[victim];
+          if ( q.empty() )
+            continue;
+          if ( victim == worker || q.back() >= limit ) {
+            if ( q.front() >= limit )
+              continue;
+            task = q.front();
+            q.pop_front();
+          } else {
+            task = q.back();
+            q.pop_back();
           }
+          --remaining_;
+          return true;
         } // for
+
+        std::unique_lock<std::mutex> lock(windowLock_);
+        if ( remaining_ == 0 )
+          return false;
+        windowMoved_.wait(lock, [this, limit] { return limit_ != limit || remaining_ == 0; });
+      } // while
+    }
+
+    // Tasks before 'committed' are done with their buffers
+    void Committed(std::size_t committed) {
+      std::lock_guard<std::mutex> guard(windowLock_);
+      limit_ = committed + window_;
+      windowMoved_.notify_all();
+    }
+
+  private:
+    std::vector< std::deque<std::size_t> > queues_;
+    std::vector<std::mutex> locks_;
+    const std::size_t window_;
+    std::atomic<std::size_t> limit_;
+    std::atomic<std::size_t> remaining_;
+    std::mutex windowLock_;
+    std::condition_variable windowMoved_;
+  };
+
+  // Split the source nodes into runs of roughly equal work, given the
+  //  estimated work of each
+  std::vector<Node> chunk_bounds(const std::vector<Count>& work, unsigned int numThreads) {
+    const Node numNodes = static_cast<Node>(work.size());
+    const Count totalWork = std::accumulate(work.begin(), work.end(), Count(0));
+    static const Count chunksPerThread = 64;
+    static const Count maxChunkWork = Count(1) << 24; // bounds the output held for one chunk
+    const Count target = std::max<Count>(1, std::min(maxChunkWork, totalWork / (chunksPerThread * numThreads)));
+    std::vector<Node> bounds(1, 0);
+    Count sofar = 0;
+    for ( Node n = 0; n < numNodes; ++n ) {
+      if ( sofar > 0 && sofar + work[n] > target ) {
+        bounds.push_back(n);
+        sofar = 0;
       }
+      sofar += work[n];
+    } // for
+    if ( numNodes > 0 )
+      bounds.push_back(numNodes);
+    return bounds;
+  }
+
+  // A hub's work grows with the square of its degree, so hubs end up alone
+  std::vector<Node> chunk_bounds(const Input& input, unsigned int numThreads) {
+    const Node numNodes = input.NumberOfNodes();
+    std::vector<Count> work(numNodes);
+    for ( Node n = 0; n < numNodes; ++n ) {
+      const Count d = input.UnidirectionalOutputEdges()[n].size()
+                    + input.UnidirectionalInputEdges()[n].size()
+                    + input.AllBidirectionalEdges()[n].size();
+      work[n] = 1 + d * d;
     } // for
+    return chunk_bounds(work, numThreads);
   }
 
-  void tre_chain(const Input& input) {
-    const BidirEdges& allBidirEdges = input.AllBidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : unidirOutEdges ) {
-      for ( auto& v : p.second ) {
-        auto w = unidirOutEdges.find(v);
-        if ( w != unidirOutEdges.end() ) {
-          std::set<std::string> z(p.second.begin(), p.second.end()), y;
-          auto k1 = unidirInEdges.find(p.first);
-          if ( k1 != unidirInEdges.end() )
-            z.insert(k1->second.begin(), k1->second.end());
-          auto k2 = allBidirEdges.find(p.first);
-          if ( k2 != allBidirEdges.end() )
-            z.insert(k2->second.begin(), k2->second.end());
-
-          std::set_difference(w->second.begin(), w->second.end(),
-                              z.begin(), z.end(),
-                              std::inserter(y, y.end()));
-          for ( auto& yout : y )
-            std::cout << "3-Chain:\t" << p.first << "\t" << v << "\t" << yout << std::endl;
+  // Run each motif's tasks over the chunks on input.Threads() workers.  With a
+  //  writer, each task's output buffer is handed to it in task order, so the
+  //  result does not depend on the number of threads.  A task whose buffer
+  //  fills up waits until every task before it has been handed over, then
+  //  hands over its own buffer and carries on; that bounds memory even when
+  //  one hub has billions of motifs.  Returns the census of what was found.
+  Census run_tasks(const Input& input, const std::vector<Pass>& passes, network_motifs::OutputWriter* writer) {
+    const bool print = (writer != nullptr);
+    const unsigned int numThreads = input.Threads();
+    const std::vector<Node> chunks = chunk_bounds(input, numThreads);
+    std::vector<Task> tasks;
+    for ( auto& pass : passes ) {
+      const std::vector<Node>& bounds = pass.bounds.empty() ? chunks : pass.bounds;
+      for ( std::size_t b = 1; b < bounds.size(); ++b ) {
+        Task t = { &pass, bounds[b-1], bounds[b] };
+        tasks.push_back(t);
+      } // for
+    } // for
+
+    const std::size_t window = print ? 8 * numThreads : tasks.size();
+    Scheduler scheduler(tasks.size(), numThreads, window);
+    std::vector<Output> outputs(print ? tasks.size() : 0);
+    std::vector<char> finished(tasks.size(), false);
+    std::size_t head = 0; // the task being written
+    std::mutex finishedLock;
+    std::condition_variable taskFinished, headMoved;
+    std::vector<Census> censuses(numThreads, Census(NumberOfMotifTypes, 0));
+    for ( std::size_t t = 0; t < outputs.size(); ++t ) {
+      outputs[t].Spill = [&, t] {
+        {
+          std::unique_lock<std::mutex> lock(finishedLock);
+          headMoved.wait(lock, [&] { return head == t; });
         }
+        writer->Write(outputs[t].text);
+      };
+    } // for
+
+    RunStats* const stats = input.Stats();
+    const double started = stats ? stats->Now() : 0;
+    std::vector<std::size_t> passNumbers;
+    if ( stats ) {
+      std::vector<std::string> names;
+      for ( auto& pass : passes )
+        names.push_back(pass.name);
+      passNumbers = stats->Passes(names, numThreads);
+    }
+    std::size_t numFinished = 0;
+    auto work = [&](unsigned int worker) {
+      CountSetOps counting(stats);
+      std::size_t t;
+      while ( scheduler.Next(worker, t) ) {
+        const Task& task = tasks[t];
+        Output* out = print ? &outputs[t] : nullptr;
+        if ( !stats )
+          task.pass->run(task.first, task.last, out, censuses[worker]);
+        else {
+          const double start = stats->Now(), cpu = thread_cpu_seconds();
+          const Count before = std::accumulate(censuses[worker].begin(), censuses[worker].end(), Count(0));
+          task.pass->run(task.first, task.last, out, censuses[worker]);
+          const Count found = std::accumulate(censuses[worker].begin(), censuses[worker].end(), Count(0)) - before;
+          stats->Task(worker, passNumbers[task.pass - passes.data()], start, stats->Now(), thread_cpu_seconds() - cpu, found);
+        }
+        std::size_t done;
+        {
+          std::lock_guard<std::mutex> guard(finishedLock);
+          finished[t] = true;
+          done = ++numFinished;
+          taskFinished.notify_one();
+        }
+        if ( stats )
+          stats->Progress(done, tasks.size(), started);
+      } // while
+    };
+
+    std::vector<std::thread> workers;
+    for ( unsigned int w = 0; w < numThreads; ++w )
+      workers.push_back(std::thread(work, w));
+
+    if ( print ) {
+      for ( std::size_t t = 0; t < tasks.size(); ++t ) {
+        {
+          std::unique_lock<std::mutex> lock(finishedLock);
+          head = t;
+          headMoved.notify_all();
+          taskFinished.wait(lock, [&] { return finished[t] != 0; });
+        }
+        writer->Write(outputs[t].text);
+        if ( t + window < tasks.size() ) // not handed out yet, so it can take the spare buffer
+          outputs[t + window].text.swap(outputs[t].text);
+        std::string().swap(outputs[t].text);
+        scheduler.Committed(t + 1);
       } // for
+    }
+
+    for ( auto& w : workers )
+      w.join();
+
+    Census census(NumberOfMotifTypes, 0);
+    for ( auto& c : censuses ) {
+      for ( int i = 0; i < NumberOfMotifTypes; ++i )
+        census[i] += c[i];
     } // for
+    return census;
   }
 
-  void v_out(const Input& input) {
-    const BidirEdges& allBidirEdges = input.AllBidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : unidirOutEdges ) {
-      std::vector<std::string> z;
-      std::set<std::string> s;
-      for ( auto& v : p.second ) {
-        s.clear(); z.clear();
-        auto w = unidirOutEdges.find(v);
-        auto x = unidirInEdges.find(v);
-        auto y = allBidirEdges.find(v);
-        if ( w != unidirOutEdges.end() )
-          s.insert(w->second.begin(), w->second.end());
-        if ( x != unidirInEdges.end() )
-          s.insert(x->second.begin(), x->second.end());
-        if ( y != allBidirEdges.end() )
-          s.insert(y->second.begin(), y->second.end());
-
-        std::set_difference(p.second.begin(), p.second.end(),
-                            s.begin(), s.end(), std::back_inserter(z));
-        for ( auto& zout : z ) {
-          if ( v < zout )
-            std::cout << "V-out:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
-        } // for
-      } // for
+  // a pass for one motif function
+  Pass motif_pass(const Input& input, MotifType type) {
+    Pass pass;
+    pass.name = MotifNames[type];
+    pass.run = [&input, type](Node first, Node last, Output* out, Census& census) {
+      if ( out ) {
+        Printer printer = { &input, out };
+        census[type] += find_instances(input, type, first, last, printer);
+      } else {
+        CountOnly count;
+        census[type] += find_instances(input, type, first, last, count);
+      }
+    };
+    return pass;
+  }
+
+  // a pass that finds every motif type at once
+  Pass triad_pass(const Input& input, const Adjacency& adjacency) {
+    Pass pass;
+    pass.name = "single-pass";
+    pass.run = [&input, &adjacency](Node first, Node last, Output* out, Census& census) {
+      if ( out ) {
+        Printer printer = { &input, out };
+        single_pass(adjacency, first, last, census, printer);
+      } else {
+        CountOnly count;
+        single_pass(adjacency, first, last, census, count);
+      }
+    };
+    return pass;
+  }
+
+  // a pass over ranks rather than node ids, finding every motif type at once
+  //  or only those that close a triangle
+  Pass degree_pass(const Input& input, const RankedAdjacency& ranked, bool trianglesOnly) {
+    Pass pass;
+    pass.name = "degree-order";
+    pass.run = [&input, &ranked, trianglesOnly](Node first, Node last, Output* out, Census& census) {
+      if ( out ) {
+        Printer printer = { &input, out };
+        ranked_pass(ranked, first, last, trianglesOnly, census, printer);
+      } else {
+        CountOnly count;
+        ranked_pass(ranked, first, last, trianglesOnly, census, count);
+      }
+    };
+    std::vector<Count> work(ranked.Size());
+    for ( Node r = 0; r < ranked.Size(); ++r )
+      work[r] = ranked.Work(r);
+    pass.bounds = chunk_bounds(work, input.Threads());
+    return pass;
+  }
+
+  // a pass over runs of seeds rather than of nodes; see seeded_pass()
+  Pass seed_pass(const Input& input, const std::vector<Node>& seeds) {
+    Pass pass;
+    pass.name = "seeds";
+    pass.run = [&input, &seeds](Node first, Node last, Output* out, Census& census) {
+      if ( out ) {
+        Printer printer = { &input, out };
+        seeded_pass(input, seeds, first, last, input.AllSeeds(), census, printer);
+      } else {
+        CountOnly count;
+        seeded_pass(input, seeds, first, last, input.AllSeeds(), census, count);
+      }
+    };
+    std::vector<Count> work(seeds.size());
+    for ( std::size_t i = 0; i < seeds.size(); ++i ) {
+      const Count d = input.UnidirectionalOutputEdges()[seeds[i]].size()
+                    + input.UnidirectionalInputEdges()[seeds[i]].size()
+                    + input.AllBidirectionalEdges()[seeds[i]].size();
+      work[i] = 1 + d * d;
     } // for
+    pass.bounds = chunk_bounds(work, input.Threads());
+    return pass;
+  }
+
+  // The ids of the labels listed by --seeds, in increasing order
+  std::vector<Node> read_seeds(const Input& input) {
+    std::ifstream file;
+    if ( input.Seeds() != "-" ) {
+      file.open(input.Seeds().c_str());
+      if ( !file )
+        throw("Unable to find seeds file: " + input.Seeds());
+    }
+    std::istream& rows = (input.Seeds() == "-") ? std::cin : file;
+
+    std::vector<Node> seeds;
+    std::size_t missing = 0;
+    std::string label;
+    while ( std::getline(rows, label) ) {
+      Node n;
+      if ( label.empty() )
+        continue;
+      else if ( input.NodeLabels().Find(label.data(), label.size(), n) )
+        seeds.push_back(n);
+      else
+        ++missing;
+    } // while
+    std::sort(seeds.begin(), seeds.end());
+    seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+    if ( missing )
+      std::cerr << missing << " seed label" << (missing > 1 ? "s are" : " is") << " not in the graph" << std::endl;
+    return seeds;
+  }
+
+  // The header and node labels that start binary output
+  void print_instance_header(const Input& input, network_motifs::OutputWriter& writer) {
+    const Labels& labels = input.NodeLabels();
+    network_motifs::InstanceHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, network_motifs::InstanceMagic, sizeof(header.magic));
+    header.version = network_motifs::InstanceVersion;
+    header.numNodes = labels.Size();
+    header.labelBytes = labels.TextBytes();
+    std::string text(reinterpret_cast<const char*>(&header), sizeof(header));
+    text.append(reinterpret_cast<const char*>(labels.Offsets()), (labels.Size() + 1) * sizeof(std::uint64_t));
+    text.append(labels.Text(), header.labelBytes);
+    text.append((8 - header.labelBytes % 8) % 8, '\0');
+    writer.Write(text);
+  }
+
+  void find_motifs(const Input& input) {
+    // everything printed goes through the writer's thread, with large writes to stdout
+    network_motifs::OutputWriter writer;
+    if ( input.Binary() )
+      print_instance_header(input, writer);
+
+    std::vector<Pass> passes;
+    if ( input.SinglePass() ) {
+      Adjacency adjacency(input);
+      passes.push_back(triad_pass(input, adjacency));
+      run_tasks(input, passes, &writer);
+    } else if ( input.DegreeOrder() ) {
+      RankedAdjacency ranked(input);
+      passes.push_back(degree_pass(input, ranked, false));
+      run_tasks(input, passes, &writer);
+    } else if ( !input.Seeds().empty() ) {
+      const std::vector<Node> seeds = read_seeds(input);
+      passes.push_back(seed_pass(input, seeds));
+      run_tasks(input, passes, &writer);
+    } else {
+      for ( int m = 0; m < NumberOfMotifTypes; ++m )
+        passes.push_back(motif_pass(input, static_cast<MotifType>(m)));
+      run_tasks(input, passes, &writer);
+    }
+    writer.Finish();
+  }
+
+  void print_census(const Census& census) {
+    for ( int m = 0; m < NumberOfMotifTypes; ++m )
+      std::cout << MotifNames[m] << "\t" << census[m] << "\n";
+    std::cout << std::flush;
+  }
+
+  Census count_motifs(const Input& input) {
+    std::vector<Pass> passes;
+    if ( input.SinglePass() ) {
+      Adjacency adjacency(input);
+      passes.push_back(triad_pass(input, adjacency));
+      return run_tasks(input, passes, nullptr);
+    } else if ( !input.Seeds().empty() ) {
+      const std::vector<Node> seeds = read_seeds(input);
+      passes.push_back(seed_pass(input, seeds));
+      return run_tasks(input, passes, nullptr);
+    }
+
+    // only those that close a triangle are searched for; see count_open_motifs()
+    if ( input.DegreeOrder() ) {
+      RankedAdjacency ranked(input);
+      passes.push_back(degree_pass(input, ranked, true));
+      Census census = run_tasks(input, passes, nullptr);
+      count_open_motifs(input, census);
+      return census;
+    }
+    for ( auto m : ClosedMotifs )
+      passes.push_back(motif_pass(input, m));
+    Census census = run_tasks(input, passes, nullptr);
+    count_open_motifs(input, census);
+    return census;
   }
 
-  void v_in(const Input& input) {
-    const BidirEdges& allBidirEdges = input.AllBidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : unidirInEdges ) {
-      std::vector<std::string> z;
-      std::set<std::string> s;
-      for ( auto& v : p.second ) {
-        s.clear(); z.clear();
-        auto w = unidirOutEdges.find(v);
-        auto x = unidirInEdges.find(v);
-        auto y = allBidirEdges.find(v);
-        if ( w != unidirOutEdges.end() )
-          s.insert(w->second.begin(), w->second.end());
-        if ( x != unidirInEdges.end() )
-          s.insert(x->second.begin(), x->second.end());
-        if ( y != allBidirEdges.end() )
-          s.insert(y->second.begin(), y->second.end());
-
-        std::set_difference(p.second.begin(), p.second.end(),
-                            s.begin(), s.end(), std::back_inserter(z));
-        for ( auto& zout : z ) {
-          if ( v < zout )
-            std::cout << "V-in:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
+  void motif_census(const Input& input) {
+    print_census(count_motifs(input));
+  }
+
+  //=======
+  // Roles
+  //=======
+  // --roles counts, for each node, the motifs it is in by type and by role.  A
+  //  node's role is its place in a listed instance, where places that differ
+  //  only by label order share a role: both targets of a V-out are Leaf.
+  const char* const RoleNames[NumberOfMotifTypes][3] = {
+    { "Source", "Middle", "Sink" },                // FFL
+    { "Member", "Member", "Member" },              // 3-Loop
+    { "Start", "Middle", "End" },                  // 3-Chain
+    { "Hub", "Leaf", "Leaf" },                     // V-out
+    { "Hub", "Leaf", "Leaf" },                     // V-in
+    { "Target", "Regulator", "Regulator" },        // Regulating-Mutual
+    { "Regulator", "Target", "Target" },           // Regulated-Mutual
+    { "Member", "Member", "Member" },              // Clique
+    { "Center", "Source", "Sink" },                // Semi-Clique
+    { "Mutual-Source", "Middle", "Mutual-Sink" },  // Mutual-And-3-Chain
+    { "Center", "Leaf", "Leaf" },                  // Mutual-V
+    { "Regulator", "Partner", "Target" },          // Mutual-Out
+    { "Target", "Partner", "Source" }              // Mutual-In
+  };
+
+  // The report's columns, one per distinct type and role
+  struct RoleColumns {
+    RoleColumns() {
+      for ( int m = 0; m < NumberOfMotifTypes; ++m ) {
+        for ( int i = 0; i < 3; ++i ) {
+          const std::string name = std::string(MotifNames[m]) + "-" + RoleNames[m][i];
+          column[m][i] = static_cast<int>(std::find(names.begin(), names.end(), name) - names.begin());
+          if ( column[m][i] == static_cast<int>(names.size()) )
+            names.push_back(name);
         } // for
       } // for
+    }
+
+    std::vector<std::string> names;
+    int column[NumberOfMotifTypes][3]; // by motif type and place
+  };
+
+  void motif_roles(const Input& input) {
+    const RoleColumns roles;
+    const std::size_t numRoles = roles.names.size();
+    const Node numNodes = input.NumberOfNodes();
+    const Adjacency adjacency(input);
+
+    // per-thread counts by node and role, summed into the first
+    const std::vector<Node> bounds = chunk_bounds(input, input.Threads());
+    std::vector< std::vector<Count> > profiles(input.Threads());
+    std::atomic<std::size_t> nextChunk(1);
+    auto work = [&](unsigned int w) {
+      CountSetOps counting(input.Stats());
+      std::vector<Count>& profile = profiles[w];
+      profile.assign(static_cast<std::size_t>(numNodes) * numRoles, 0);
+      for ( std::size_t b = nextChunk++; b < bounds.size(); b = nextChunk++ ) {
+        visit_triads(adjacency, bounds[b-1], bounds[b], [&](const Triad& t, const Node n[3]) {
+          for ( int i = 0; i < 3; ++i )
+            ++profile[n[t.order[i]] * numRoles + roles.column[t.type][i]];
+        });
+      } // for
+    };
+    std::vector<std::thread> workers;
+    for ( unsigned int w = 0; w < input.Threads(); ++w )
+      workers.push_back(std::thread(work, w));
+    for ( auto& w : workers )
+      w.join();
+    std::vector<Count>& profile = profiles[0];
+    for ( std::size_t w = 1; w < profiles.size(); ++w ) {
+      for ( std::size_t i = 0; i < profile.size(); ++i )
+        profile[i] += profiles[w][i];
+      std::vector<Count>().swap(profiles[w]);
     } // for
-  }
 
-  void regulating_mutual(const Input& input) {
-    // print node associated with 2 unidir edges, then remaining edges in alphabetical order
-    const BidirEdges& bidirEdges = input.BidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    for ( auto& p : bidirEdges ) {
-      auto out_p = unidirOutEdges.find(p.first);
-      if ( out_p != unidirOutEdges.end() ) {
-        for ( auto& v : p.second ) {
-          auto out_v = unidirOutEdges.find(v);
-          if ( out_v != unidirOutEdges.end() ) {
-            std::vector<std::string> z;
-            std::set_intersection(out_p->second.begin(), out_p->second.end(),
-                                  out_v->second.begin(), out_v->second.end(),
-                                  std::back_inserter(z));
-            for ( auto& zout : z )
-              std::cout << "Regulating-Mutual:\t" << zout << "\t" << p.first << "\t" << v << std::endl;
-          }
+    const Labels& labels = input.NodeLabels();
+    network_motifs::OutputWriter writer;
+    std::string text;
+    if ( input.Top() ) {
+      // the K nodes with the most motifs in each role; ties go by label
+      text = "Role\tRank\tNode\tCount\n";
+      std::vector<Node> order(numNodes);
+      for ( std::size_t r = 0; r < numRoles; ++r ) {
+        for ( Node n = 0; n < numNodes; ++n )
+          order[n] = n;
+        const std::size_t k = std::min<std::size_t>(input.Top(), numNodes);
+        std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](Node a, Node b) {
+          const Count ca = profile[a * numRoles + r], cb = profile[b * numRoles + r];
+          return ca != cb ? ca > cb : a < b;
+        });
+        for ( std::size_t i = 0; i < k && profile[order[i] * numRoles + r]; ++i ) {
+          text += roles.names[r];
+          text += '\t';
+          network_motifs::append_number(text, static_cast<long>(i + 1));
+          text += '\t';
+          text.append(labels.Data(order[i]), labels.Length(order[i]));
+          text += '\t';
+          network_motifs::append_number(text, static_cast<long>(profile[order[i] * numRoles + r]));
+          text += '\n';
         } // for
-      }
-    } // for
+        writer.Write(text);
+      } // for
+    } else {
+      text = "Node";
+      for ( auto& name : roles.names )
+        text += '\t' + name;
+      text += '\n';
+      for ( Node n = 0; n < numNodes; ++n ) {
+        text.append(labels.Data(n), labels.Length(n));
+        for ( std::size_t r = 0; r < numRoles; ++r ) {
+          text += '\t';
+          network_motifs::append_number(text, static_cast<long>(profile[n * numRoles + r]));
+        } // for
+        text += '\n';
+        if ( text.size() >= (1 << 20) )
+          writer.Write(text);
+      } // for
+      writer.Write(text);
+    }
+    writer.Finish();
+  }
+
+  //============
+  // Estimation
+  //============
+  // --estimate samples wedges, pairs of joined node pairs that share a node,
+  //  uniformly: a center with probability in proportion to its number of
+  //  wedges, then two of its neighbors.  A connected triple holds 1 wedge if two
+  //  of its pairs are joined and 3 if all are, so with W wedges in the graph and
+  //  a fraction p of samples of a type with w wedges, W * p / w estimates its
+  //  count.  Samples are taken in rounds, each from its own random stream and
+  //  added up in round order, so where sampling stops for --error does not
+  //  depend on the number of threads.
+
+  // wedges in one motif of a type
+  int wedges_per_triple(int type) {
+    switch ( type ) {
+      case FFL: case TreLoop: case RegulatingMutual: case RegulatedMutual:
+      case Clique: case SemiClique: case MutualAnd3Chain:
+        return 3; // every pair is joined
+      default:
+        return 1;
+    };
   }
 
-  void regulated_mutual(const Input& input) {
-    // Print node associated with 2 unidir edges, then remaining edges in alphabetical order
-    const BidirEdges& bidirEdges = input.BidirectionalEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : bidirEdges ) {
-      auto in_p = unidirInEdges.find(p.first);
-      if ( in_p != unidirInEdges.end() ) {
-        for ( auto& v : p.second ) {
-          auto in_v = unidirInEdges.find(v);
-          if ( in_v != unidirInEdges.end() ) {
-            std::vector<std::string> z;
-            std::set_intersection(in_p->second.begin(), in_p->second.end(),
-                                  in_v->second.begin(), in_v->second.end(),
-                                  std::back_inserter(z));
-            for ( auto& zout : z )
-              std::cout << "Regulated-Mutual:\t" << zout << "\t" << p.first << "\t" << v << std::endl;
+  void estimate_motifs(const Input& input) {
+    const Adjacency adjacency(input);
+    const Node numNodes = input.NumberOfNodes();
+    std::vector<Count> below(numNodes + 1, 0); // wedges centered on nodes before n
+    for ( Node n = 0; n < numNodes; ++n ) {
+      const Count d = adjacency[n].size();
+      below[n+1] = below[n] + d * (d - 1) / 2;
+    } // for
+    const Count wedges = below[numNodes];
+
+    // how x is joined to y
+    auto relation = [&adjacency](Node x, Node y) -> unsigned int {
+      const bool fromX = (adjacency[x].size() <= adjacency[y].size());
+      const Neighbors nbrs = adjacency[fromX ? x : y];
+      const Node* at = std::lower_bound(nbrs.begin(), nbrs.end(), fromX ? y : x);
+      if ( at == nbrs.end() || *at != (fromX ? y : x) )
+        return 0;
+      const unsigned int r = adjacency.Kinds(fromX ? x : y)[at - nbrs.begin()];
+      return fromX ? r : flip(r);
+    };
+
+    static const Count RoundSize = 1 << 16;
+    auto round = [&](std::size_t r, Census& found) {
+      std::seed_seq seq = { input.Seed(), static_cast<unsigned long>(r) };
+      std::mt19937_64 rng(seq);
+      std::uniform_int_distribution<Count> pick(0, wedges - 1);
+      for ( Count i = 0; i < RoundSize; ++i ) {
+        const Count w = pick(rng);
+        const Node c = static_cast<Node>(std::upper_bound(below.begin() + 1, below.end(), w) - (below.begin() + 1));
+        const std::size_t d = adjacency[c].size();
+        const std::size_t x = std::uniform_int_distribution<std::size_t>(0, d - 1)(rng);
+        std::size_t y = std::uniform_int_distribution<std::size_t>(0, d - 2)(rng);
+        y += (y >= x);
+        const Node a = adjacency[c].begin()[x], b = adjacency[c].begin()[y];
+        const std::uint8_t* kc = adjacency.Kinds(c);
+        ++found[triadTable.entries[triad_code(kc[x], kc[y], relation(a, b))].type];
+      } // for
+    };
+
+    // workers take rounds in order; the main thread adds up finished rounds in
+    //  order and says when to stop
+    Census total(NumberOfMotifTypes, 0);
+    Count samples = 0;
+    const auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    if ( wedges > 0 ) {
+      std::atomic<std::size_t> nextRound(0);
+      std::atomic<bool> done(false);
+      std::mutex lock;
+      std::condition_variable finished;
+      std::map<std::size_t, Census> pending; // finished rounds not yet added
+      auto work = [&] {
+        while ( !done ) {
+          const std::size_t r = nextRound++;
+          Census found(NumberOfMotifTypes, 0);
+          round(r, found);
+          std::lock_guard<std::mutex> guard(lock);
+          pending[r].swap(found);
+          finished.notify_one();
+        } // while
+      };
+      std::vector<std::thread> workers;
+      for ( unsigned int w = 0; w < input.Threads(); ++w )
+        workers.push_back(std::thread(work));
+
+      const auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                      std::chrono::duration<double>(input.Seconds() > 0 ? input.Seconds() : 1e9));
+      const double e = input.RelativeError();
+      for ( std::size_t r = 0; !done; ++r ) {
+        Census found;
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          if ( !finished.wait_until(guard, deadline, [&] { return pending.count(r) != 0; }) ) {
+            done = true; // out of time: leave this round out
+            break;
           }
-        } // for
+          found.swap(pending[r]);
+          pending.erase(r);
+        }
+        for ( int t = 0; t < NumberOfMotifTypes; ++t )
+          total[t] += found[t];
+        samples += RoundSize;
+
+        if ( e > 0 ) { // are all types of at least a fraction e within e?
+          bool close = true;
+          for ( int t = 0; t < NumberOfMotifTypes && close; ++t ) {
+            const double p = static_cast<double>(total[t]) / samples;
+            if ( p >= e )
+              close = (1.96 * std::sqrt(p * (1 - p) / samples) <= e * p);
+          } // for
+          done = close;
+        }
+      } // for
+      for ( auto& w : workers )
+        w.join();
+      elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if ( samples == 0 ) { // with no wedges, the all-zero census is exact
+        std::stringstream conv; conv << RoundSize;
+        throw("--seconds ran out before a first round of " + conv.str() + " samples was taken; give it more time");
       }
+    }
+
+    std::vector<double> estimate(NumberOfMotifTypes, 0), halfWidth(NumberOfMotifTypes, 0);
+    double all = 0;
+    for ( int t = 0; t < NumberOfMotifTypes && samples > 0; ++t ) {
+      const double p = static_cast<double>(total[t]) / samples;
+      const double scale = static_cast<double>(wedges) / wedges_per_triple(t);
+      estimate[t] = scale * p;
+      halfWidth[t] = scale * 1.96 * std::sqrt(p * (1 - p) / samples);
+      all += estimate[t];
+    } // for
+
+    std::cerr << "Took " << samples << " samples of " << wedges << " wedges in " << elapsed << " seconds" << std::endl;
+    std::cout << "Motif-Type\tEstimate\tCI95-Low\tCI95-High\tConcentration\n";
+    for ( int t = 0; t < NumberOfMotifTypes; ++t ) {
+      std::cout << MotifNames[t] << "\t" << std::fixed << std::setprecision(0) << estimate[t]
+                << "\t" << std::max(0.0, estimate[t] - halfWidth[t]) << "\t" << estimate[t] + halfWidth[t]
+                << "\t" << std::setprecision(6) << (all > 0 ? estimate[t] / all : 0) << "\n";
     } // for
+    std::cout << std::flush;
   }
 
-  void clique(const Input& input) {
-    // remember bidirEdges.first has A only if A < B and A<->B (otherwise it has B as .first)
-    const BidirEdges& bidirEdges = input.BidirectionalEdges();
-    for ( auto& p : bidirEdges ) {
-      for ( auto& v : p.second ) {
-        auto w = bidirEdges.find(v);
-        if ( w != bidirEdges.end() ) {
-          std::vector<std::string> z;
-          std::set_intersection(p.second.begin(), p.second.end(),
-                                w->second.begin(), w->second.end(),
-                                std::back_inserter(z));
-          for ( auto& zout : z )
-            std::cout << "Clique:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
+  //============
+  // Null model
+  //============
+  // Random graphs with the degrees of the input: each node keeps its numbers of
+  //  unidirectional in- and out-edges and of bidirectional edges.  Edges are
+  //  rewired by switches, A->B plus C->D becoming A->D plus C->B, and likewise
+  //  for bidirectional edges, skipped when they would join nodes already joined.
+
+  // Open-addressing set of directed edges
+  class EdgeSet {
+  public:
+    explicit EdgeSet(std::size_t most) : shift_(64) {
+      std::size_t size = 1;
+      while ( size < 2 * most ) {
+        size *= 2;
+        --shift_;
+      } // while
+      slots_.assign(size, Edge(Empty));
+    }
+
+    bool Has(Edge e) const {
+      const std::size_t mask = slots_.size() - 1;
+      for ( std::size_t i = home(e); slots_[i] != Empty; i = (i + 1) & mask ) {
+        if ( slots_[i] == e )
+          return true;
+      } // for
+      return false;
+    }
+
+    void Insert(Edge e) {
+      const std::size_t mask = slots_.size() - 1;
+      std::size_t i = home(e);
+      while ( slots_[i] != Empty )
+        i = (i + 1) & mask;
+      slots_[i] = e;
+    }
+
+    // e must be present; later members of its run are shifted back over it
+    void Erase(Edge e) {
+      const std::size_t mask = slots_.size() - 1;
+      std::size_t i = home(e);
+      while ( slots_[i] != e )
+        i = (i + 1) & mask;
+      for ( std::size_t j = (i + 1) & mask; slots_[j] != Empty; j = (j + 1) & mask ) {
+        const std::size_t k = home(slots_[j]);
+        const bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if ( !stays ) {
+          slots_[i] = slots_[j];
+          i = j;
         }
       } // for
+      slots_[i] = Empty;
+    }
+
+  private:
+    static const Edge Empty = ~Edge(0);
+    std::size_t home(Edge e) const {
+      return (shift_ == 64) ? 0 : static_cast<std::size_t>((e * 0x9e3779b97f4a7c15ull) >> shift_);
+    }
+
+    std::vector<Edge> slots_;
+    int shift_;
+  };
+
+  // Apply up to 'attempts' switches to uni (A->B) and mutual (A<->B, A < B) edges
+  void rewire(std::vector<Edge>& uni, std::vector<Edge>& mutual, Count attempts, std::mt19937_64& rng) {
+    const std::size_t total = uni.size() + mutual.size();
+    if ( total == 0 )
+      return;
+    EdgeSet arcs(uni.size() + 2 * mutual.size());
+    for ( auto e : uni )
+      arcs.Insert(e);
+    for ( auto e : mutual ) {
+      arcs.Insert(e);
+      arcs.Insert(pack(target(e), source(e)));
+    } // for
+    auto joined = [&arcs](Node x, Node y) { return arcs.Has(pack(x, y)) || arcs.Has(pack(y, x)); };
+
+    std::uniform_int_distribution<std::size_t> any(0, total - 1);
+    for ( Count k = 0; k < attempts; ++k ) {
+      const bool isUni = (any(rng) < uni.size()); // classes picked in proportion to their sizes
+      std::vector<Edge>& edges = isUni ? uni : mutual;
+      std::uniform_int_distribution<std::size_t> pick(0, edges.size() - 1);
+      const std::size_t i = pick(rng), j = pick(rng);
+      Node a = source(edges[i]), b = target(edges[i]), c = source(edges[j]), d = target(edges[j]);
+      if ( !isUni && (rng() & 1) )
+        std::swap(c, d); // either way round is a switch for an undirected pair
+      if ( a == c || a == d || b == c || b == d || joined(a, d) || joined(c, b) )
+        continue;
+
+      arcs.Erase(pack(a, b));
+      arcs.Erase(pack(c, d));
+      arcs.Insert(pack(a, d));
+      arcs.Insert(pack(c, b));
+      if ( isUni ) {
+        edges[i] = pack(a, d);
+        edges[j] = pack(c, b);
+      } else {
+        arcs.Erase(pack(b, a));
+        arcs.Erase(pack(d, c));
+        arcs.Insert(pack(d, a));
+        arcs.Insert(pack(b, c));
+        edges[i] = pack(std::min(a, d), std::max(a, d));
+        edges[j] = pack(std::min(b, c), std::max(b, c));
+      }
     } // for
   }
 
-  void semi_clique(const Input& input) {
-    const BidirEdges& allBidirEdges = input.AllBidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    for ( auto& p : allBidirEdges ) {
-      for ( auto& v : p.second ) {
-        auto w = unidirOutEdges.find(v);
-        if ( w != unidirOutEdges.end() ) {
-          std::vector<std::string> z;
-          std::set_intersection(p.second.begin(), p.second.end(),
-                                w->second.begin(), w->second.end(),
-                                std::back_inserter(z));
-          for ( auto& zout : z )
-            std::cout << "Semi-Clique:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
-        }
+  // Census of the input against Replicates() rewired copies of it
+  void null_model(const Input& input) {
+    const Census observed = count_motifs(input);
+
+    std::vector<Edge> uni, mutual;
+    for ( Node n = 0; n < input.NumberOfNodes(); ++n ) {
+      for ( auto x : input.UnidirectionalOutputEdges()[n] )
+        uni.push_back(pack(n, x));
+      for ( auto x : input.BidirectionalEdges()[n] )
+        mutual.push_back(pack(n, x));
+    } // for
+
+    // each replicate has its own random stream, so results do not depend on threads
+    const std::size_t replicates = input.Replicates();
+    std::vector<Census> random(replicates);
+    std::atomic<std::size_t> next(0);
+    auto work = [&] {
+      for ( std::size_t r; (r = next++) < replicates; ) {
+        std::seed_seq seq = { input.Seed(), static_cast<unsigned long>(r) };
+        std::mt19937_64 rng(seq);
+        std::vector<Edge> u(uni), m(mutual);
+        rewire(u, m, input.SwapsPerEdge() * (u.size() + m.size()), rng);
+        Input graph(input, u, m);
+        random[r] = count_motifs(graph);
       } // for
+    };
+    std::vector<std::thread> workers;
+    for ( std::size_t w = 0; w < std::min<std::size_t>(input.Threads(), replicates); ++w )
+      workers.push_back(std::thread(work));
+    for ( auto& w : workers )
+      w.join();
+
+    std::cout << "Motif-Type\tObserved\tRandom-Mean\tRandom-SD\tZ-Score\n";
+    std::cout << std::fixed << std::setprecision(3);
+    for ( int t = 0; t < NumberOfMotifTypes; ++t ) {
+      double mean = 0, var = 0;
+      for ( auto& c : random )
+        mean += c[t];
+      mean /= replicates;
+      for ( auto& c : random )
+        var += (c[t] - mean) * (c[t] - mean);
+      const double sd = (replicates > 1) ? std::sqrt(var / (replicates - 1)) : 0;
+      std::cout << MotifNames[t] << "\t" << observed[t] << "\t" << mean << "\t" << sd << "\t";
+      if ( sd > 0 )
+        std::cout << (observed[t] - mean) / sd << "\n";
+      else
+        std::cout << "NA\n";
     } // for
+    std::cout << std::flush;
   }
 
-  void mutual_tre_chain(const Input& input) {
-    const BidirEdges& allBidirEdges = input.AllBidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : allBidirEdges ) {
-      auto out_p = unidirOutEdges.find(p.first);
-      if ( out_p != unidirOutEdges.end() ) {
-        for ( auto& v : p.second ) {
-          auto in_v = unidirInEdges.find(v);
-          if ( in_v != unidirInEdges.end() ) {
-            std::vector<std::string> z;
-            std::set_intersection(out_p->second.begin(), out_p->second.end(),
-                                  in_v->second.begin(), in_v->second.end(),
-                                  std::back_inserter(z));
-            for ( auto& zout : z )
-              std::cout << "Mutual-And-3-Chain:\t" << p.first << "\t" << zout << "\t" << v << std::endl;
-          }
-        } // for
-      }
+  //=============
+  // Graph edits
+  //=============
+  // --edits applies '+A<tab>B' (add A->B) and '-A<tab>B' (remove A->B) rows to
+  //  the input graph one at a time.  Only triples holding both A and B can
+  //  change, so each edit classifies {A, B, X} before and after, for every
+  //  neighbor X of A or B, with the table used by single_pass().
+
+  // The input graph in a form that takes edits: each node's neighbors, sorted
+  //  by id, with how they are joined (Adjacency::Out, In or Mutual).  Nodes
+  //  first seen in an edit get ids after the input's.
+  class EditableGraph {
+  public:
+    explicit EditableGraph(const Input& input);
+
+    // id of label; a new node is added when 'add', else false is returned
+    bool Find(const std::string& label, bool add, Node& n);
+    void AppendLabel(std::string& s, Node n) const;
+    // label order, which is id order among the input's nodes
+    bool Before(Node x, Node y) const;
+
+    // how x is joined to y, 0 if not at all
+    unsigned int Relation(Node x, Node y) const;
+    void SetRelation(Node x, Node y, unsigned int r);
+
+    struct Link {
+      Node node;
+      std::uint8_t kind;
+    };
+    const std::vector<Link>& Links(Node n) const { return links_[n]; }
+
+  private:
+    static bool below(const Link& k, Node n) { return k.node < n; }
+    void set(Node x, Node y, unsigned int r);
+
+    const Labels& labels_;
+    const Node base_; // nodes of the input
+    std::vector<std::string> added_;
+    std::unordered_map<std::string, Node> addedIds_;
+    std::vector< std::vector<Link> > links_;
+  };
+
+  EditableGraph::EditableGraph(const Input& input) : labels_(input.NodeLabels()), base_(input.NumberOfNodes()),
+                                                     links_(input.NumberOfNodes()) {
+    Adjacency adjacency(input);
+    for ( Node n = 0; n < base_; ++n ) {
+      const Neighbors nbrs = adjacency[n];
+      const std::uint8_t* kinds = adjacency.Kinds(n);
+      links_[n].reserve(nbrs.size());
+      for ( std::size_t i = 0; i < nbrs.size(); ++i ) {
+        const Link k = { nbrs.begin()[i], kinds[i] };
+        links_[n].push_back(k);
+      } // for
     } // for
   }
 
-  void mutual_v(const Input& input) {
-    const BidirEdges& allBidirEdges = input.AllBidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : allBidirEdges ) {
-      std::vector<std::string> z;
-      std::set<std::string> s;
-      for ( auto& v : p.second ) {
-        s.clear(); z.clear();
-        auto w = unidirOutEdges.find(v);
-        auto x = unidirInEdges.find(v);
-        auto y = allBidirEdges.find(v);
-        if ( w != unidirOutEdges.end() )
-          s.insert(w->second.begin(), w->second.end());
-        if ( x != unidirInEdges.end() )
-          s.insert(x->second.begin(), x->second.end());
-        if ( y != allBidirEdges.end() )
-          s.insert(y->second.begin(), y->second.end());
-
-        std::set_difference(p.second.begin(), p.second.end(),
-                            s.begin(), s.end(), std::back_inserter(z));
-        for ( auto& zout : z ) {
-          if ( v < zout )
-            std::cout << "Mutual-V:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
-        } // for
+  bool EditableGraph::Find(const std::string& label, bool add, Node& n) {
+    if ( labels_.Find(label.data(), label.size(), n) )
+      return true;
+
+    auto i = addedIds_.find(label);
+    if ( i != addedIds_.end() ) {
+      n = i->second;
+      return true;
+    }
+    if ( !add )
+      return false;
+    n = static_cast<Node>(base_ + added_.size());
+    added_.push_back(label);
+    addedIds_[label] = n;
+    links_.push_back(std::vector<Link>());
+    return true;
+  }
+
+  void EditableGraph::AppendLabel(std::string& s, Node n) const {
+    if ( n < base_ )
+      s.append(labels_.Data(n), labels_.Length(n));
+    else
+      s.append(added_[n - base_]);
+  }
+
+  bool EditableGraph::Before(Node x, Node y) const {
+    if ( x < base_ && y < base_ )
+      return x < y;
+    std::string a, b;
+    AppendLabel(a, x);
+    AppendLabel(b, y);
+    return a < b;
+  }
+
+  unsigned int EditableGraph::Relation(Node x, Node y) const {
+    const std::vector<Link>& l = links_[x];
+    auto i = std::lower_bound(l.begin(), l.end(), y, below);
+    return (i != l.end() && i->node == y) ? i->kind : 0;
+  }
+
+  void EditableGraph::SetRelation(Node x, Node y, unsigned int r) {
+    set(x, y, r);
+    set(y, x, flip(r));
+  }
+
+  void EditableGraph::set(Node x, Node y, unsigned int r) {
+    std::vector<Link>& l = links_[x];
+    auto i = std::lower_bound(l.begin(), l.end(), y, below);
+    if ( i != l.end() && i->node == y ) {
+      if ( r )
+        i->kind = static_cast<std::uint8_t>(r);
+      else
+        l.erase(i);
+    } else if ( r ) {
+      const Link k = { y, static_cast<std::uint8_t>(r) };
+      l.insert(i, k);
+    }
+  }
+
+  // Type of the triple n[0..2] (NumberOfMotifTypes if it is not connected), given
+  //  how n[i] is joined to n[j] in rel[i][j]; its nodes go to out in print order
+  int classify(const EditableGraph& graph, const Node n[3], const unsigned int rel[3][3], Node out[3]) {
+    int p[3] = { 0, 1, 2 }; // positions in label order
+    if ( graph.Before(n[p[1]], n[p[0]]) )
+      std::swap(p[0], p[1]);
+    if ( graph.Before(n[p[2]], n[p[1]]) ) {
+      std::swap(p[1], p[2]);
+      if ( graph.Before(n[p[1]], n[p[0]]) )
+        std::swap(p[0], p[1]);
+    }
+    int code = 0;
+    for ( int i = 0; i < 3; ++i ) {
+      for ( int j = i + 1; j < 3; ++j ) {
+        const unsigned int r = rel[p[i]][p[j]];
+        code |= ((r & 1) << edge_bit(i, j)) | ((r >> 1) << edge_bit(j, i));
       } // for
     } // for
+    const Triad& t = triadTable.entries[code];
+    for ( int i = 0; i < 3; ++i )
+      out[i] = n[p[t.order[i]]];
+    return t.type;
   }
 
-  void mutual_out(const Input& input) {
-    const BidirEdges& allBidirEdges = input.AllBidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : allBidirEdges ) {
-      auto out_p = unidirOutEdges.find(p.first);
-      if ( out_p != unidirOutEdges.end() ) {
-        std::vector<std::string> z;
-        std::set<std::string> s;
-        for ( auto& v : p.second ) {
-          z.clear(); s.clear();
-          auto w = unidirOutEdges.find(v);
-          auto x = unidirInEdges.find(v);
-          auto y = allBidirEdges.find(v);
-          if ( w != unidirOutEdges.end() )
-            s.insert(w->second.begin(), w->second.end());
-          if ( x != unidirInEdges.end() )
-            s.insert(x->second.begin(), x->second.end());
-          if ( y != allBidirEdges.end() )
-            s.insert(y->second.begin(), y->second.end());
-
-          std::set_difference(out_p->second.begin(), out_p->second.end(),
-                              s.begin(), s.end(), std::back_inserter(z));
-          for ( auto& zout : z )
-            std::cout << "Mutual-Out:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
-        } // for
+  // One reported instance: "FFL:<tab>A<tab>B<tab>C"
+  void append_instance(const EditableGraph& graph, std::string& s, int type, const Node nodes[3]) {
+    s.append(MotifNames[type]);
+    s.push_back(':');
+    for ( int i = 0; i < 3; ++i ) {
+      s.push_back('\t');
+      graph.AppendLabel(s, nodes[i]);
+    } // for
+  }
+
+  // Set how a is joined to b to r, adjusting census and listing what changes in text
+  void edit_pair(EditableGraph& graph, Node a, Node b, unsigned int r, Census& census, std::string* text) {
+    const unsigned int old = graph.Relation(a, b);
+    if ( old == r )
+      return;
+
+    std::vector<Node> others; // every node joined to a or b
+    for ( auto& k : graph.Links(a) )
+      others.push_back(k.node);
+    for ( auto& k : graph.Links(b) )
+      others.push_back(k.node);
+    std::sort(others.begin(), others.end());
+    others.erase(std::unique(others.begin(), others.end()), others.end());
+
+    for ( auto x : others ) {
+      if ( x == a || x == b )
+        continue;
+      const Node n[3] = { a, b, x };
+      const unsigned int ax = graph.Relation(a, x), bx = graph.Relation(b, x);
+      const unsigned int before[3][3] = { { 0, old, ax }, { flip(old), 0, bx }, { flip(ax), flip(bx), 0 } };
+      const unsigned int after[3][3] = { { 0, r, ax }, { flip(r), 0, bx }, { flip(ax), flip(bx), 0 } };
+      Node was[3], is[3];
+      const int from = classify(graph, n, before, was);
+      const int to = classify(graph, n, after, is);
+      if ( from == to && std::equal(was, was + 3, is) )
+        continue;
+      if ( from != NumberOfMotifTypes )
+        --census[from];
+      if ( to != NumberOfMotifTypes )
+        ++census[to];
+      if ( !text )
+        continue;
+      if ( from == NumberOfMotifTypes ) {
+        text->append("Appeared\t");
+        append_instance(graph, *text, to, is);
+      } else if ( to == NumberOfMotifTypes ) {
+        text->append("Disappeared\t");
+        append_instance(graph, *text, from, was);
+      } else {
+        text->append("Changed\t");
+        append_instance(graph, *text, from, was);
+        text->push_back('\t');
+        append_instance(graph, *text, to, is);
       }
+      text->push_back('\n');
     } // for
+    graph.SetRelation(a, b, r);
   }
 
-  void mutual_in(const Input& input) {
-    const BidirEdges& allBidirEdges = input.AllBidirectionalEdges();
-    const UniEdges& unidirOutEdges = input.UnidirectionalOutputEdges();
-    const UniEdges& unidirInEdges = input.UnidirectionalInputEdges();
-    for ( auto& p : allBidirEdges ) {
-      auto in_p = unidirInEdges.find(p.first);
-      if ( in_p != unidirInEdges.end() ) {
-        std::vector<std::string> z;
-        std::set<std::string> s;
-        for ( auto& v : p.second ) {
-          z.clear(); s.clear();
-          auto w = unidirOutEdges.find(v);
-          auto x = unidirInEdges.find(v);
-          auto y = allBidirEdges.find(v);
-          if ( w != unidirOutEdges.end() )
-            s.insert(w->second.begin(), w->second.end());
-          if ( x != unidirInEdges.end() )
-            s.insert(x->second.begin(), x->second.end());
-          if ( y != allBidirEdges.end() )
-            s.insert(y->second.begin(), y->second.end());
-
-          std::set_difference(in_p->second.begin(), in_p->second.end(),
-                              s.begin(), s.end(), std::back_inserter(z));
-          for ( auto& zout : z )
-            std::cout << "Mutual-In:\t" << p.first << "\t" << v << "\t" << zout << std::endl;
-        } // for
+  void apply_edits(const Input& input) {
+    std::ifstream file;
+    if ( input.Edits() != "-" ) {
+      file.open(input.Edits().c_str());
+      if ( !file )
+        throw("Unable to find edits file: " + input.Edits());
+    }
+    std::istream& edits = (input.Edits() == "-") ? std::cin : file;
+
+    const bool listing = !input.CountsOnly();
+    Census census = listing ? Census(NumberOfMotifTypes, 0) : count_motifs(input);
+    EditableGraph graph(input);
+    network_motifs::OutputWriter writer;
+    std::string text, row;
+    std::size_t rowid = 0;
+    while ( std::getline(edits, row) ) {
+      ++rowid;
+      const std::string::size_type p = row.find('\t');
+      if ( row.empty() || (row[0] != '+' && row[0] != '-') || p == std::string::npos ) {
+        std::stringstream conv; conv << rowid;
+        throw("Edits must look like +A<tab>B or -A<tab>B; see row: " + conv.str());
       }
+      const bool add = (row[0] == '+');
+      Node a, b;
+      if ( !graph.Find(row.substr(1, p - 1), add, a) || !graph.Find(row.substr(p + 1), add, b) || a == b )
+        continue; // nothing to remove, or a self-edge
+
+      // A->B and B->A together are one bidirectional edge
+      const unsigned int old = graph.Relation(a, b);
+      const unsigned int r = add ? (old | Adjacency::Out) : (old & ~static_cast<unsigned int>(Adjacency::Out));
+      if ( listing && r != old )
+        text.append("Edit\t" + row + "\n");
+      edit_pair(graph, a, b, r, census, listing ? &text : nullptr);
+      writer.Write(text); // an edit's report goes out before the next edit is read
+    } // while
+    writer.Finish();
+
+    if ( !listing )
+      print_census(census);
+  }
+
+  //=============
+  // Graph cache
+  //=============
+  // A graph cache holds the node labels and the four adjacency structures of
+  //  Input, laid out so they can be used where they are mapped: a GraphHeader,
+  //  the label offsets and text, then for each of allBis_, bis_, outs_ and
+  //  ins_ its offsets and targets.  Each array starts on an 8-byte boundary.
+  //  Numbers are in the byte order of the machine that wrote the cache.
+
+  struct GraphHeader {
+    char magic[8];
+    std::uint32_t version;
+    Node numNodes;
+    std::uint64_t sourceSize; // the text file the graph was parsed from
+    std::int64_t sourceTime; // its modification time in ns
+    std::uint64_t sourceChecksum;
+    std::uint64_t labelBytes;
+    std::uint64_t numEdges[4];
+  };
+
+  const char GraphMagic[8] = { '3', 'N', 'M', 'G', 'R', 'A', 'P', 'H' };
+  const std::uint32_t GraphVersion = 1;
+
+  inline std::uint64_t padded(std::uint64_t bytes) { return (bytes + 7) & ~std::uint64_t(7); }
+
+  std::uint64_t checksum(const char* data, std::size_t size) {
+    std::uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+    std::uint64_t w;
+    for ( ; size >= 8; data += 8, size -= 8 ) {
+      std::memcpy(&w, data, 8);
+      h = (h ^ w) * 0xff51afd7ed558ccdull;
+      h ^= h >> 32;
     } // for
+    w = 0;
+    std::memcpy(&w, data, size);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 29);
   }
 
-  void find_motifs(const Input& input) {
-    ffl(input);
-    tre_loop(input);
-    tre_chain(input);
-    v_out(input);
-    v_in(input);
-    regulating_mutual(input);
-    regulated_mutual(input);
-    clique(input);
-    semi_clique(input);
-    mutual_tre_chain(input);
-    mutual_v(input);
-    mutual_out(input);
-    mutual_in(input);
-  }
-
-  Input::Input(int argc, char** argv) {
+  // size and modification time of a file, or false if it cannot be looked at
+  bool file_stamp(const std::string& path, std::uint64_t& size, std::int64_t& time) {
+    struct stat info;
+    if ( ::stat(path.c_str(), &info) != 0 )
+      return false;
+    size = static_cast<std::uint64_t>(info.st_size);
+    time = static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    return true;
+  }
+
+  // The header of a cache for labels_ and edge counts numEdges, parsed from source
+  GraphHeader Input::Header(const MappedFile& source, const std::uint64_t numEdges[4]) const {
+    GraphHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, GraphMagic, sizeof(GraphMagic));
+    header.version = GraphVersion;
+    header.numNodes = labels_.Size();
+    header.sourceSize = source.Size();
+    header.sourceChecksum = checksum(source.Data(), source.Size());
+    header.labelBytes = labels_.TextBytes();
+    for ( int i = 0; i < 4; ++i )
+      header.numEdges[i] = numEdges[i];
+    std::uint64_t size = 0;
+    if ( !file_stamp(inputPath_, size, header.sourceTime) || size != source.Size() )
+      header.sourceTime = -1; // not a plain file: always checksum on load
+    return header;
+  }
+
+  void Input::SaveGraph(const std::string& path, const MappedFile& source) const {
+    const Csr* parts[] = { &allBis_, &bis_, &outs_, &ins_ };
+    std::uint64_t numEdges[4];
+    for ( int i = 0; i < 4; ++i )
+      numEdges[i] = parts[i]->NumberOfEdges();
+    const GraphHeader header = Header(source, numEdges);
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    const char zeros[8] = { 0 };
+    auto put = [&out, &zeros](const void* data, std::uint64_t bytes) {
+      out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+      out.write(zeros, static_cast<std::streamsize>(padded(bytes) - bytes));
+    };
+    const std::uint64_t offsetBytes = (static_cast<std::uint64_t>(header.numNodes) + 1) * sizeof(std::uint64_t);
+    put(&header, sizeof(header));
+    put(labels_.Offsets(), offsetBytes);
+    put(labels_.Text(), header.labelBytes);
+    for ( auto part : parts ) {
+      put(part->Offsets(), offsetBytes);
+      put(part->Targets(), part->NumberOfEdges() * sizeof(Node));
+    } // for
+    out.close();
+    if ( !out )
+      throw("Unable to write graph cache: " + path);
+  }
+
+  void Input::LoadGraph(const std::string& path, const std::string& source) {
+    cache_.reset(new MappedFile(path, "graph cache", MappedFile::Random));
+    const char* at = cache_->Data();
+    GraphHeader header;
+    if ( cache_->Size() < sizeof(header) )
+      throw("Not a graph cache: " + path);
+    std::memcpy(&header, at, sizeof(header));
+    if ( std::memcmp(header.magic, GraphMagic, sizeof(GraphMagic)) != 0 )
+      throw("Not a graph cache: " + path);
+    if ( header.version != GraphVersion )
+      throw("Graph cache " + path + " is from another version; rebuild it with --save-graph");
+
+    // a changed source is caught by its checksum, which is only read when its
+    //  size or time differ from those recorded
+    std::uint64_t size = 0;
+    std::int64_t time = 0;
+    const bool found = file_stamp(source, size, time);
+    if ( !found || size != header.sourceSize || time != header.sourceTime ) {
+      MappedFile text(source, "input file");
+      if ( text.Size() != header.sourceSize || checksum(text.Data(), text.Size()) != header.sourceChecksum )
+        throw("Graph cache " + path + " is stale for " + source + "; rebuild it with --save-graph");
+    }
+
+    MapGraph(path);
+  }
+
+  // Use the graph in cache_, which has a valid header
+  void Input::MapGraph(const std::string& path) {
+    const char* at = cache_->Data();
+    const char* const end = at + cache_->Size();
+    GraphHeader header;
+    std::memcpy(&header, at, sizeof(header));
+
+    // check the layout before using any of it
+    const std::uint64_t offsetBytes = (static_cast<std::uint64_t>(header.numNodes) + 1) * sizeof(std::uint64_t);
+    std::uint64_t total = padded(sizeof(header)) + offsetBytes + padded(header.labelBytes);
+    for ( int i = 0; i < 4; ++i )
+      total += offsetBytes + padded(header.numEdges[i] * sizeof(Node));
+    if ( total != cache_->Size() )
+      throw("Graph cache is damaged: " + path);
+
+    auto take = [&at](std::uint64_t bytes) { const char* here = at; at += padded(bytes); return here; };
+    take(sizeof(header));
+    const std::uint64_t* offsets = reinterpret_cast<const std::uint64_t*>(take(offsetBytes));
+    labels_.View(header.numNodes, offsets, take(header.labelBytes));
+    Csr* parts[] = { &allBis_, &bis_, &outs_, &ins_ };
+    for ( int i = 0; i < 4; ++i ) {
+      offsets = reinterpret_cast<const std::uint64_t*>(take(offsetBytes));
+      const Node* targets = reinterpret_cast<const Node*>(take(header.numEdges[i] * sizeof(Node)));
+      if ( offsets[0] != 0 || offsets[header.numNodes] != header.numEdges[i] )
+        throw("Graph cache is damaged: " + path);
+      parts[i]->View(header.numNodes, offsets, targets);
+    } // for
+    if ( at != end || labels_.Offsets()[header.numNodes] != header.labelBytes )
+      throw("Graph cache is damaged: " + path);
+  }
+
+  Input::Input(int argc, char** argv) : countsOnly_(false), singlePass_(false), degreeOrder_(false), allSeeds_(false), binary_(false), roles_(false),
+                                             estimate_(false), reportMemory_(false), top_(0), memoryLimit_(0), seconds_(0),
+                                             error_(0), replicates_(0), swaps_(10), seed_(1), threads_(1), hubDegree_(-1) {
     for ( int i = 1; i < argc; ++i ) {
       if ( std::string(argv[i]) == "--help" || std::string(argv[i]) == "-h" )
         throw(Help());
     } // for
-    if ( argc != 2 )
+
+    std::string saveGraph, loadGraph;
+    int argcntr = 1;
+    for ( ; argcntr < argc - 1; ++argcntr ) {
+      const std::string next(argv[argcntr]);
+      if ( next == "--counts" )
+        countsOnly_ = true;
+      else if ( next == "--single-pass" )
+        singlePass_ = true;
+      else if ( next == "--degree-order" )
+        degreeOrder_ = true;
+      else if ( next == "--all-seeds" )
+        allSeeds_ = true;
+      else if ( next == "--binary" )
+        binary_ = true;
+      else if ( next == "--roles" )
+        roles_ = true;
+      else if ( next == "--estimate" )
+        estimate_ = true;
+      else if ( (next == "--seconds" || next == "--error") && argcntr + 1 < argc - 1 ) {
+        std::stringstream conv(argv[++argcntr]);
+        double x = 0;
+        if ( !(conv >> x) || !conv.eof() || !(x > 0) || (next == "--error" && !(x < 1)) )
+          throw(Usage() + "\n" + next + " expects a positive number" + (next == "--error" ? " below 1: " : ": ") + argv[argcntr]);
+        (next == "--seconds" ? seconds_ : error_) = x;
+      }
+      else if ( next == "--threads" && argcntr + 1 < argc - 1 ) {
+        std::stringstream conv(argv[++argcntr]);
+        int n = 0;
+        if ( !(conv >> n) || !conv.eof() || n < 1 )
+          throw(Usage() + "\n--threads expects a positive integer: " + argv[argcntr]);
+        threads_ = static_cast<unsigned int>(n);
+      } else if ( next == "--hub-degree" && argcntr + 1 < argc - 1 ) {
+        std::stringstream conv(argv[++argcntr]);
+        if ( !(conv >> hubDegree_) || !conv.eof() || hubDegree_ < 0 )
+          throw(Usage() + "\n--hub-degree expects a non-negative integer: " + argv[argcntr]);
+        reportMemory_ = true;
+      } else if ( (next == "--random" || next == "--swaps" || next == "--seed" || next == "--top") && argcntr + 1 < argc - 1 ) {
+        std::stringstream conv(argv[++argcntr]);
+        unsigned long n = 0;
+        if ( conv.peek() == '-' || !(conv >> n) || !conv.eof() || (n == 0 && next != "--seed") )
+          throw(Usage() + "\n" + next + " expects a positive integer: " + argv[argcntr]);
+        if ( next == "--random" )
+          replicates_ = n;
+        else if ( next == "--swaps" )
+          swaps_ = n;
+        else if ( next == "--top" )
+          top_ = n;
+        else
+          seed_ = n;
+      } else if ( next == "--memory-limit" && argcntr + 1 < argc - 1 ) {
+        std::stringstream conv(argv[++argcntr]);
+        unsigned long mb = 0;
+        if ( conv.peek() == '-' || !(conv >> mb) || !conv.eof() || mb == 0 || mb > (~std::size_t(0) >> 20) )
+          throw(Usage() + "\n--memory-limit expects a positive number of MB: " + argv[argcntr]);
+        memoryLimit_ = static_cast<std::size_t>(mb) << 20;
+      } else if ( next == "--stats" && argcntr + 1 < argc - 1 )
+        stats_.reset(new RunStats(argv[++argcntr]));
+      else if ( next == "--edits" && argcntr + 1 < argc - 1 )
+        edits_ = argv[++argcntr];
+      else if ( next == "--seeds" && argcntr + 1 < argc - 1 )
+        seeds_ = argv[++argcntr];
+      else if ( next == "--save-graph" && argcntr + 1 < argc - 1 )
+        saveGraph = argv[++argcntr];
+      else if ( next == "--load-graph" && argcntr + 1 < argc - 1 )
+        loadGraph = argv[++argcntr];
+      else
+        throw(Usage() + "\nUnrecognized option: " + next);
+    } // for
+    if ( argcntr != argc - 1 )
       throw(Usage());
+    if ( binary_ && (countsOnly_ || replicates_ || !edits_.empty()) )
+      throw(Usage() + "\n--binary cannot be used with --counts, --random or --edits");
+    if ( replicates_ && !edits_.empty() )
+      throw(Usage() + "\n--random and --edits cannot be used together");
+    if ( roles_ && (countsOnly_ || binary_ || replicates_ || !edits_.empty()) )
+      throw(Usage() + "\n--roles cannot be used with --counts, --binary, --random or --edits");
+    if ( degreeOrder_ && (singlePass_ || roles_ || replicates_ || !edits_.empty() || estimate_) )
+      throw(Usage() + "\n--degree-order cannot be used with --single-pass, --roles, --random, --edits or --estimate");
+    if ( !seeds_.empty() && (singlePass_ || degreeOrder_ || roles_ || replicates_ || !edits_.empty() || estimate_) )
+      throw(Usage() + "\n--seeds cannot be used with --single-pass, --degree-order, --roles, --random, --edits or --estimate");
+    if ( allSeeds_ && seeds_.empty() )
+      throw(Usage() + "\n--all-seeds is used with --seeds");
+    if ( top_ && !roles_ )
+      throw(Usage() + "\n--top is used with --roles");
+    if ( estimate_ && (countsOnly_ || binary_ || roles_ || replicates_ || !edits_.empty()) )
+      throw(Usage() + "\n--estimate cannot be used with --counts, --binary, --roles, --random or --edits");
+    if ( (seconds_ > 0 || error_ > 0) && !estimate_ )
+      throw(Usage() + "\n--seconds and --error are used with --estimate");
+    if ( estimate_ && seconds_ == 0 && error_ == 0 )
+      error_ = 0.01;
+    if ( !saveGraph.empty() && !loadGraph.empty() )
+      throw(Usage() + "\n--save-graph and --load-graph cannot be used together");
+    if ( memoryLimit_ && (replicates_ || !edits_.empty()) )
+      throw(Usage() + "\n--memory-limit cannot be used with --random or --edits");
+    inputPath_ = argv[argcntr];
+
+    if ( !loadGraph.empty() )
+      LoadGraph(loadGraph, inputPath_);
+    else if ( memoryLimit_ ) {
+      MappedFile file(inputPath_, "input file");
+      ReadOutOfCore(file, saveGraph);
+    } else {
+      MappedFile file(inputPath_, "input file");
+      Read(file);
+      if ( !saveGraph.empty() )
+        SaveGraph(saveGraph, file);
+    }
+    if ( stats_ )
+      stats_->Phase(loadGraph.empty() ? "read" : "load");
 
-    std::ifstream infile(argv[1]);
-    if ( !infile )
-      throw(std::string("Unable to find input file: ") + argv[1]);
+    BuildHubs();
+    if ( hubs_.NumberOfHubs() > 0 ) // the default degree builds rows too
+      reportMemory_ = true;
+    if ( stats_ )
+      stats_->Phase("hubs");
+  }
 
-    std::string nodeA, nodeB;
-    ByLine bline;
-    std::string::size_type p;
-    std::set<std::string> uniques;
-    std::size_t rowid = 0;
-    while ( infile >> bline ) {
-      ++rowid;
-      if ( (p = bline.find('\t')) == std::string::npos ) {
-        std::stringstream conv; conv << rowid;
-        throw("No tab found at row: " + conv.str());
-      }
+  Input::Input(const Input& model, std::vector<Edge>& uni, std::vector<Edge>& mutual)
+                : countsOnly_(true), singlePass_(false), degreeOrder_(false), allSeeds_(false), binary_(false), roles_(false), estimate_(false),
+                  reportMemory_(false), top_(0), memoryLimit_(0), seconds_(0), error_(0), replicates_(0), swaps_(0), seed_(0),
+                  threads_(1), hubDegree_(model.hubDegree_) {
+    Build(model.NumberOfNodes(), uni, mutual);
+    BuildHubs();
+  }
+
+  void Input::BuildHubs() {
+    Node threshold = (hubDegree_ >= 0)
+                       ? static_cast<Node>(std::min<long>(hubDegree_, ~Node(0)))
+                       : DefaultHubDegree(NumberOfNodes());
+    if ( memoryLimit_ && hubDegree_ < 0 ) {
+      // raise the default until the rows take no more than a quarter of the limit
+      const std::uint64_t rowBytes = 2 * ((static_cast<std::uint64_t>(NumberOfNodes()) + 63) / 64) * sizeof(Word);
+      auto hubs = [this](Node t) {
+        std::uint64_t h = 0;
+        for ( Node n = 0; n < NumberOfNodes(); ++n )
+          h += (outs_[n].size() + ins_[n].size() + allBis_[n].size() >= t);
+        return h;
+      };
+      while ( threshold > 0 && hubs(threshold) * rowBytes > memoryLimit_ / 4 )
+        threshold = (threshold > ~Node(0) / 2) ? 0 : 2 * threshold;
+    }
+    Graph::BuildHubs(threshold);
+  }
+
+  //===================
+  // Out-of-core build
+  //===================
+  // With --memory-limit, the graph is built by passes over files instead of in
+  //  memory, in the graph cache layout, and then mapped.  Parsed rows go to a
+  //  file.  Once labels are sorted, the node ids are cut into blocks whose
+  //  edges fit the limit, and every edge is filed under the block of its
+  //  source and its reversal under the block of its target.  Blocks are then
+  //  read back one at a time, sorted, and their edges joined with their
+  //  reversals to give the rows of all four adjacency structures in node order.
+  //  The limit holds for the build alone.  The search goes over the mapping
+  //  like any other, and the kernel keeps as much of it resident as memory
+  //  allows.
+
+  // An unnamed file in $TMPDIR (default /tmp), written through a buffer and
+  //  read back from any offset once flushed
+  class ScratchFile {
+  public:
+    static const std::size_t Buffer = 1 << 14;
+
+    ScratchFile();
+    ~ScratchFile() { ::close(fd_); }
+
+    void Put(const void* data, std::size_t bytes);
+    template <typename T>
+    void Put(const T& x) { Put(&x, sizeof(x)); }
+    void Flush();
+
+    // bytes put so far
+    std::uint64_t Size() const { return size_; }
+    // bytes [at, at + n) of what was put and flushed
+    void Get(std::uint64_t at, void* data, std::size_t n) const;
+
+  private:
+    ScratchFile(const ScratchFile&); // not copyable
+    ScratchFile& operator=(const ScratchFile&);
+
+    int fd_;
+    std::uint64_t size_;
+    std::vector<char> buf_;
+  };
+
+  // A new file under $TMPDIR, named in path; the caller closes fd
+  int make_temporary(std::string& path) {
+    const char* dir = std::getenv("TMPDIR");
+    path = std::string((dir && *dir) ? dir : "/tmp") + "/find3.XXXXXX";
+    const int fd = ::mkstemp(&path[0]);
+    if ( fd < 0 )
+      throw("Unable to create a temporary file in " + path.substr(0, path.rfind('/')));
+    return fd;
+  }
 
-      if ( !uniques.insert(bline).second ) // not a unique edge
-        continue; // otherwise, could add A->B, remove if B->A occurs, and re-add A->B later
+  ScratchFile::ScratchFile() : size_(0) {
+    std::string path;
+    fd_ = make_temporary(path);
+    ::unlink(path.c_str()); // gone once closed
+    buf_.reserve(Buffer);
+  }
+
+  void ScratchFile::Put(const void* data, std::size_t bytes) {
+    if ( buf_.size() + bytes > Buffer )
+      Flush();
+    const char* p = static_cast<const char*>(data);
+    buf_.insert(buf_.end(), p, p + bytes);
+    size_ += bytes;
+  }
 
-      nodeA = bline.substr(0, p); nodeB = bline.substr(++p);
-      if ( nodeA == nodeB ) // no self-edges in 3-node motifs
+  void ScratchFile::Flush() {
+    const char* p = buf_.data();
+    std::size_t left = buf_.size();
+    while ( left > 0 ) {
+      const ssize_t n = ::write(fd_, p, left);
+      if ( n < 0 && errno == EINTR )
         continue;
+      if ( n <= 0 )
+        throw(std::string("Unable to write a temporary file (is $TMPDIR full?)"));
+      p += n;
+      left -= static_cast<std::size_t>(n);
+    } // while
+    buf_.clear();
+  }
 
-      auto iterB = outs_.find(nodeB);
-      if ( iterB != outs_.end() && iterB->second.find(nodeA) != iterB->second.end() ) {
-        // have A->B and B->A.  Remove edges from UniEdges lists.  Put in BidirEdges list.
-        iterB->second.erase(nodeA);
-        ins_.find(nodeA)->second.erase(nodeB);
-
-        std::string preferred_source = (nodeA < nodeB) ? nodeA : nodeB;
-        std::string preferred_target = (nodeA < nodeB) ? nodeB : nodeA;
-        auto iterC = bis_.find(preferred_source);
-        auto iterD = allBis_.find(preferred_source), iterE = allBis_.find(preferred_target);
-        if ( iterC != bis_.end() )
-          iterC->second.insert(preferred_target);            
-        else {
-          std::set<std::string> s;
-          s.insert(preferred_target);
-          bis_.insert(std::make_pair(preferred_source, s));
-        }
+  void ScratchFile::Get(std::uint64_t at, void* data, std::size_t n) const {
+    char* p = static_cast<char*>(data);
+    while ( n > 0 ) {
+      const ssize_t got = ::pread(fd_, p, n, static_cast<off_t>(at));
+      if ( got < 0 && errno == EINTR )
+        continue;
+      if ( got <= 0 )
+        throw(std::string("Unable to read a temporary file"));
+      p += got;
+      at += static_cast<std::uint64_t>(got);
+      n -= static_cast<std::size_t>(got);
+    } // while
+  }
 
-        if ( iterD != allBis_.end() )
-          iterD->second.insert(preferred_target);
-        else {
-          std::set<std::string> s;
-          s.insert(preferred_target);
-          allBis_.insert(std::make_pair(preferred_source, s));
-        }
+  // The distinct edges of a block file, sorted
+  void load_block(const ScratchFile& file, std::vector<Edge>& edges, Node numNodes) {
+    edges.resize(file.Size() / sizeof(Edge));
+    file.Get(0, edges.data(), file.Size());
+    radix_sort(edges, numNodes);
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  }
 
-        if ( iterE != allBis_.end() )
-          iterE->second.insert(preferred_source);
-        else {
-          std::set<std::string> s;
-          s.insert(preferred_source);
-          allBis_.insert(std::make_pair(preferred_target, s));
-        }
-      } else {
-        auto iterA = outs_.find(nodeA);
-        if ( iterA == outs_.end() ) {
-          std::set<std::string> s;
-          s.insert(nodeB);
-          outs_.insert(std::make_pair(nodeA, s));
-        } else {
-          iterA->second.insert(nodeB);
-        }
-        auto iterB = ins_.find(nodeB);
-        if ( iterB == ins_.end() ) {
-          std::set<std::string> s;
-          s.insert(nodeA);
-          ins_.insert(std::make_pair(nodeB, s));
-        } else {
-          iterB->second.insert(nodeA);
-        }
+  void Input::ReadOutOfCore(const MappedFile& file, const std::string& savePath) {
+    // rows in ids of first appearance, repeats and all, and the number of
+    //  rows at each node
+    std::vector<std::string> labels;
+    std::vector<std::uint64_t> rows;
+    std::unique_ptr<ScratchFile> edges(new ScratchFile);
+    parse_rows(file, labels, [&labels, &rows, &edges](Node a, Node b) {
+      edges->Put(pack(a, b));
+      if ( rows.size() < labels.size() )
+        rows.resize(labels.size(), 0);
+      ++rows[a];
+      ++rows[b];
+    });
+    edges->Flush();
+
+    const Node numNodes = static_cast<Node>(labels.size());
+    std::vector<Node> rank = sort_labels(labels);
+    labels_.Build(labels);
+    std::vector<std::string>().swap(labels);
+    {
+      std::vector<std::uint64_t> sorted(numNodes, 0);
+      for ( Node n = 0; n < rows.size(); ++n )
+        sorted[rank[n]] = rows[n];
+      rows.swap(sorted);
+    }
+
+    // Whatever the node arrays and file buffers leave of the limit holds one
+    //  block's edges and reversals, plus as much again while sorting.  A node
+    //  with more rows than that is a block of its own and goes over.
+    const std::size_t MaxBlocks = 256;
+    const std::size_t fixed = labels_.Bytes() + static_cast<std::size_t>(numNodes) * (sizeof(Node) + 2 * sizeof(std::uint64_t))
+                                + (2 * MaxBlocks + 9) * ScratchFile::Buffer;
+    if ( memoryLimit_ <= fixed + (std::size_t(1) << 20) ) {
+      std::stringstream conv; conv << ((fixed >> 20) + 2);
+      throw("--memory-limit is too small for the scratch file buffers plus the node labels and arrays of this graph; it needs more than " + conv.str() + " MB");
+    }
+    const std::uint64_t capacity = (memoryLimit_ - fixed) / (2 * sizeof(Edge));
+
+    std::vector<Node> firsts(1, 0); // the first node of each block, then numNodes
+    std::uint64_t load = 0;
+    for ( Node n = 0; n < numNodes; ++n ) {
+      if ( load > 0 && load + rows[n] > capacity ) {
+        firsts.push_back(n);
+        load = 0;
       }
-    } // while
+      load += rows[n];
+    } // for
+    firsts.push_back(numNodes);
+    std::vector<std::uint64_t>().swap(rows);
+    const std::size_t numBlocks = firsts.size() - 1;
+    if ( numBlocks > MaxBlocks )
+      throw(std::string("--memory-limit is too small for the edges of this graph; try a larger one"));
+    auto block = [&firsts](Node n) {
+      return static_cast<std::size_t>(std::upper_bound(firsts.begin() + 1, firsts.end() - 1, n) - firsts.begin() - 1);
+    };
+
+    std::vector< std::unique_ptr<ScratchFile> > outward(numBlocks), inward(numBlocks);
+    for ( std::size_t k = 0; k < numBlocks; ++k ) {
+      outward[k].reset(new ScratchFile);
+      inward[k].reset(new ScratchFile);
+    } // for
+    {
+      std::vector<Edge> chunk(static_cast<std::size_t>(std::min<std::uint64_t>(capacity, 1 << 16)));
+      for ( std::uint64_t at = 0; at < edges->Size(); ) {
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(chunk.size(), (edges->Size() - at) / sizeof(Edge)));
+        edges->Get(at, chunk.data(), n * sizeof(Edge));
+        at += n * sizeof(Edge);
+        for ( std::size_t i = 0; i < n; ++i ) {
+          const Node a = rank[source(chunk[i])], b = rank[target(chunk[i])];
+          outward[block(a)]->Put(pack(a, b));
+          inward[block(b)]->Put(pack(b, a));
+        } // for
+      } // for
+    }
+    edges.reset();
+    std::vector<Node>().swap(rank);
+    for ( std::size_t k = 0; k < numBlocks; ++k ) {
+      outward[k]->Flush();
+      inward[k]->Flush();
+    } // for
+
+    // A->B in both a block's edges and its reversals is bidirectional
+    ScratchFile offsets[4], targets[4]; // allBis_, bis_, outs_ and ins_, as in a cache
+    std::uint64_t numEdges[4] = { 0, 0, 0, 0 };
+    std::vector<Edge> out, in;
+    for ( std::size_t k = 0; k < numBlocks; ++k ) {
+      load_block(*outward[k], out, numNodes);
+      outward[k].reset();
+      load_block(*inward[k], in, numNodes);
+      inward[k].reset();
+      std::size_t i = 0, j = 0;
+      for ( Node n = firsts[k]; n < firsts[k+1]; ++n ) {
+        for ( int p = 0; p < 4; ++p )
+          offsets[p].Put(numEdges[p]);
+        while ( true ) {
+          const bool isOut = (i < out.size() && source(out[i]) == n);
+          const bool isIn = (j < in.size() && source(in[j]) == n);
+          if ( isOut && isIn && out[i] == in[j] ) {
+            const Node x = target(out[i]);
+            targets[0].Put(x);
+            ++numEdges[0];
+            if ( n < x ) {
+              targets[1].Put(x);
+              ++numEdges[1];
+            }
+            ++i;
+            ++j;
+          } else if ( isOut && (!isIn || out[i] < in[j]) ) {
+            targets[2].Put(target(out[i++]));
+            ++numEdges[2];
+          } else if ( isIn ) {
+            targets[3].Put(target(in[j++]));
+            ++numEdges[3];
+          } else
+            break;
+        } // while
+      } // for
+    } // for
+    std::vector<Edge>().swap(out);
+    std::vector<Edge>().swap(in);
+    for ( int p = 0; p < 4; ++p ) {
+      offsets[p].Put(numEdges[p]);
+      offsets[p].Flush();
+      targets[p].Flush();
+    } // for
+
+    // write the cache, to savePath or a file that is removed once mapped
+    std::string path = savePath;
+    if ( path.empty() )
+      ::close(make_temporary(path));
+    try {
+      const GraphHeader header = Header(file, numEdges);
+      std::ofstream cache(path.c_str(), std::ios::binary | std::ios::trunc);
+      const char zeros[8] = { 0 };
+      auto put = [&cache, &zeros](const void* data, std::uint64_t bytes) {
+        cache.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        cache.write(zeros, static_cast<std::streamsize>(padded(bytes) - bytes));
+      };
+      std::vector<char> buf(1 << 16);
+      auto copy = [&put, &buf](const ScratchFile& from) {
+        for ( std::uint64_t at = 0; at < from.Size(); at += buf.size() ) {
+          const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(buf.size(), from.Size() - at));
+          from.Get(at, buf.data(), n);
+          put(buf.data(), n); // only the last piece can need padding
+        } // for
+      };
+      put(&header, sizeof(header));
+      put(labels_.Offsets(), (static_cast<std::uint64_t>(numNodes) + 1) * sizeof(std::uint64_t));
+      put(labels_.Text(), header.labelBytes);
+      for ( int p = 0; p < 4; ++p ) {
+        copy(offsets[p]);
+        copy(targets[p]);
+      } // for
+      cache.close();
+      if ( !cache )
+        throw("Unable to write graph cache: " + path);
+      cache_.reset(new MappedFile(path, "graph cache", MappedFile::Random));
+    } catch(...) {
+      if ( savePath.empty() )
+        std::remove(path.c_str());
+      throw;
+    }
+    if ( savePath.empty() )
+      std::remove(path.c_str()); // the mapping stays
+    MapGraph(path);
+  }
+
+  std::string Input::MemoryReport() const {
+    const std::size_t listBytes = allBis_.Bytes() + bis_.Bytes() + outs_.Bytes() + ins_.Bytes();
+    std::stringstream msg;
+    msg << "Node labels: " << labels_.Bytes() << " bytes for " << labels_.Size() << " nodes";
+    msg << "\nNeighbor lists: " << listBytes << " bytes";
+    if ( cache_ )
+      msg << "\nGraph cache: " << cache_->Size() << " bytes mapped in place of the two above";
+    msg << "\nHub bitsets: " << hubs_.Bytes() << " bytes for " << hubs_.NumberOfHubs() << " hubs";
+    return msg.str();
   }
 } // unnamed
@@ -0,0 +1,87 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#ifndef NETWORK_MOTIFS_MAPPED_FILE_HPP
+#define NETWORK_MOTIFS_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace network_motifs {
+
+  //============
+  // MappedFile
+  //============
+  // The bytes of a whole file, mapped read-only where the file allows it and
+  //  read into memory otherwise (pipes and the like).  Errors name the file
+  //  as 'what', e.g. "input file".  A file read front to back is mapped with
+  //  Sequential, so the kernel reads ahead and drops pages behind; one whose
+  //  pages are used in no particular order, such as a graph cache, with Random.
+  class MappedFile {
+  public:
+    enum Access { Sequential, Random };
+
+    explicit MappedFile(const std::string& path, const std::string& what = "file", Access access = Sequential);
+    ~MappedFile();
+
+    const char* Data() const { return data_; }
+    std::size_t Size() const { return size_; }
+
+  private:
+    MappedFile(const MappedFile&); // not copyable
+    MappedFile& operator=(const MappedFile&);
+
+    const char* data_;
+    std::size_t size_;
+    void* map_;
+    std::vector<char> copy_;
+  };
+
+  inline MappedFile::MappedFile(const std::string& path, const std::string& what, Access access)
+                                  : data_(nullptr), size_(0), map_(nullptr) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if ( fd < 0 )
+      throw("Unable to find " + what + ": " + path);
+
+    struct stat info;
+    if ( ::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 ) {
+      void* m = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if ( m != MAP_FAILED ) {
+        ::madvise(m, static_cast<std::size_t>(info.st_size), (access == Sequential) ? MADV_SEQUENTIAL : MADV_RANDOM);
+        map_ = m;
+        data_ = static_cast<const char*>(m);
+        size_ = static_cast<std::size_t>(info.st_size);
+      }
+    }
+
+    if ( !map_ ) {
+      char chunk[1 << 16];
+      ssize_t got;
+      while ( (got = ::read(fd, chunk, sizeof(chunk))) > 0 )
+        copy_.insert(copy_.end(), chunk, chunk + got);
+      const bool failed = (got < 0);
+      data_ = copy_.data();
+      size_ = copy_.size();
+      if ( failed ) {
+        ::close(fd);
+        throw("Unable to read " + what + ": " + path);
+      }
+    }
+    ::close(fd);
+  }
+
+  inline MappedFile::~MappedFile() {
+    if ( map_ )
+      ::munmap(map_, size_);
+  }
+
+} // namespace network_motifs
+
+#endif // NETWORK_MOTIFS_MAPPED_FILE_HPP
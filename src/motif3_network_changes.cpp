@@ -5,126 +5,265 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <map>
-#include <set>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "mapped_file.hpp"
+#include "motif_compare.hpp"
+#include "motif_instances.hpp"
+#include "output_writer.hpp"
+#include "triads.hpp"
 
-namespace {
-  enum MotifType {
-    Vout = 0, Vin, TreChain, MutualIn, MutualOut, MutualV, FFL, TreLoop, RegulatedMutual,
-    RegulatingMutual, MutualAnd3Chain, SemiClique, Clique,
-
-    /* guys with a single node whose position is important */
-    Vout_diff, Vin_diff,
-
-    /* guys where every node's position matters */
-    TreChain_diff, MutualIn_diff, MutualOut_diff, FFL_diff,
-
-    /* more guys with a single node whose position is important */
-    RegulatingMutual_diff, RegulatedMutual_diff, MutualV_diff,
+#include <unistd.h>
 
-    /* more guys where every node's position matters */
-    MutualAnd3Chain_diff, SemiClique_diff,
 
-    /* no 3-node motif in target set */
-    NoMatch,
-
-    NumberOfBaseTypes = 13, NumberOfTotalTypes = 25
-  };
+namespace {
+  using namespace network_motifs::changes;
 
-  typedef std::map< std::string, std::set<std::string> > NetworkType;
-  typedef NetworkType BidirEdges;
-  typedef NetworkType UniEdges;
+  typedef std::string Names; // Nodes C, A, B in a FFL will be represented as A\0B\0C for --stream
 
-  typedef std::string Names; // Nodes C, A, B in a FFL will be represented as ABC for quick lookup
-  typedef std::vector<std::string> NodeOrder; // Actual node order; only matters for some motif types
-  typedef std::map< Names, std::pair<MotifType, NodeOrder> > NodeLookup;
+  struct Help {};
 
-  typedef std::map< MotifType, std::vector<long> > Counts;
+  //=========
+  // Printer
+  //=========
+  // Output text is gathered here and handed to a writer thread in large pieces
+  struct Printer {
+    Printer& operator<<(const char* s) { buf_.append(s); return flush_if_full(); }
+    Printer& operator<<(const std::string& s) { buf_.append(s); return flush_if_full(); }
+    Printer& operator<<(char c) { buf_.push_back(c); return flush_if_full(); }
+    Printer& operator<<(long n) { network_motifs::append_number(buf_, n); return flush_if_full(); }
 
+    void Finish() { writer_.Write(buf_); writer_.Finish(); }
 
-  //========
-  // ByLine
-  //========
-  struct ByLine : public std::string {
-    friend std::istream& operator>>(std::istream& is, ByLine& b) {
-      std::getline(is, b);
-      return(is);
+  private:
+    Printer& flush_if_full() {
+      if ( buf_.size() >= (1 << 20) )
+        writer_.Write(buf_);
+      return *this;
     }
-  };
 
-  struct Help {};
+    std::string buf_;
+    network_motifs::OutputWriter writer_;
+  };
 
   //===========
   // CheckArgs
   //===========
   struct CheckArgs {
-    CheckArgs(int argc, char**argv) : details_(false) {
+    CheckArgs(int argc, char**argv) : details_(false), stream_(false), targetGraph_(false), bufferMB_(256),
+                                      threads_(std::max(1u, std::thread::hardware_concurrency())) {
       for ( int i = 1; i < argc; ++i ) {
         if ( std::string(argv[i]) == "--help" || std::string(argv[i]) == "-h" )
           throw(Help());
       } // for
 
-      unsigned int argcntr = 1;
-      if ( argc == 4 ) {
-        details_ = (argv[argcntr] == std::string("--details"));
-        if ( !details_ )
-          throw(Usage() + std::string("\nUnrecognized option: ") + argv[argcntr]);
-        ++argcntr;
-      } else if ( argc != 3 ) {
-        throw(Usage());
+      std::vector<std::string> files;
+      std::string batch;
+      for ( int argcntr = 1; argcntr < argc; ++argcntr ) {
+        const std::string next = argv[argcntr];
+        if ( next == "--details" && !details_ )
+          details_ = true;
+        else if ( next == "--stream" && !stream_ )
+          stream_ = true;
+        else if ( next == "--target-graph" && !targetGraph_ )
+          targetGraph_ = true;
+        else if ( next == "--buffer" && argcntr + 1 < argc ) {
+          std::stringstream conv(argv[++argcntr]);
+          if ( !(conv >> bufferMB_) || !conv.eof() || bufferMB_ == 0 )
+            throw(Usage() + "\n--buffer expects a positive number of megabytes");
+        } else if ( next == "--batch" && argcntr + 1 < argc && batch.empty() ) {
+          batch = argv[++argcntr];
+        } else if ( next == "--threads" && argcntr + 1 < argc ) {
+          std::stringstream conv(argv[++argcntr]);
+          if ( !(conv >> threads_) || !conv.eof() || threads_ == 0 )
+            throw(Usage() + "\n--threads expects a positive number");
+        } else if ( next.size() > 2 && next.compare(0, 2, "--") == 0 ) {
+          throw(Usage() + "\nUnrecognized option: " + next);
+        } else {
+          files.push_back(next);
+        }
+      } // for
+
+      if ( !batch.empty() ) {
+        if ( !files.empty() || details_ || stream_ || targetGraph_ )
+          throw(Usage() + "\n--batch takes no other files, and cannot be used with --details, --stream or --target-graph");
+        std::ifstream list(batch.c_str());
+        if ( !list )
+          throw("Unable to find batch file: " + batch);
+        std::string line;
+        while ( std::getline(list, line) ) {
+          if ( line.empty() )
+            continue;
+          if ( !std::ifstream(line.c_str()) )
+            throw("Unable to find file: " + line + " (listed in " + batch + ")");
+          batch_.push_back(line);
+        } // while
+        if ( batch_.size() < 2 )
+          throw("--batch needs at least 2 files listed in " + batch);
+        return;
       }
 
-      std::ifstream targetfile(argv[argcntr]);
+      if ( files.size() != 2 )
+        throw(Usage());
+
+      std::ifstream targetfile(files[0].c_str());
       if ( !targetfile )
-        throw(std::string("Unable to find target file: ") + argv[argcntr]);
-      target_ = argv[argcntr];
+        throw("Unable to find target file: " + files[0]);
+      target_ = files[0];
 
-      ++argcntr;
-      std::ifstream reffile(argv[argcntr]);
+      std::ifstream reffile(files[1].c_str());
       if ( !reffile )
-        throw(std::string("Unable to find reference file: ") + argv[argcntr]);
-      ref_ = argv[argcntr];
+        throw("Unable to find reference file: " + files[1]);
+      ref_ = files[1];
     }
 
     bool Details() const { return details_; }
+    bool Stream() const { return stream_; }
+    bool TargetGraph() const { return targetGraph_; }
+    std::size_t BufferBytes() const { return bufferMB_ << 20; }
     std::string TargetFile() const { return target_; }
     std::string ReferenceFile() const { return ref_; }
+    const std::vector<std::string>& BatchFiles() const { return batch_; }
+    unsigned int Threads() const { return threads_; }
 
     static std::string Usage() {
-      std::string msg = "[--details] <target-network-file> <reference-network-file>";
+      std::string msg = "[--details] [--stream [--buffer <MB>]] [--target-graph] <target-network-file> <reference-network-file>";
+      msg += "\n  or: --batch <list-file> [--threads <N>]";
       msg += "\nHow do the 3-node circuits found in <reference-network-file> map onto the same nodes in <target-network-file>?";
       msg += "\n : Note that each input files should be the results of running a directed graph through the 'find_3node_motifs'";
-      msg += "\n    program.";
+      msg += "\n    program, as text or with its --binary option.";
       msg += "\n : --details shows each circuit's mapping.  Without --details, a high-level count summary is produced.";
+      msg += "\n : --stream reads both files in order of their node triples and compares them in a single pass, so";
+      msg += "\n    memory use does not grow with file size.  Files not already in that order are sorted first, in";
+      msg += "\n    pieces of up to --buffer MB (default 256) kept in $TMPDIR (default /tmp).";
+      msg += "\n : --target-graph takes <target-network-file> to be a directed graph, as given to 'find_3node_motifs',";
+      msg += "\n    and looks up the edges among each reference circuit's nodes in it directly.";
+      msg += "\n : --batch compares every ordered pair of the motif files named, one per line, in <list-file>, reading";
+      msg += "\n    each file once.  The count summaries of all pairs are given in one table, whose first two columns";
+      msg += "\n    name the target and reference files.  --threads N compares N pairs at a time (default: all cores).";
       return msg;
     }
 
   private:
     std::string target_, ref_;
-    bool details_;
+    std::vector<std::string> batch_;
+    bool details_, stream_, targetGraph_;
+    std::size_t bufferMB_;
+    unsigned int threads_;
   };
 
 
+  //==============
+  // SortedMotifs
+  //==============
+  // The motifs of a file in names() order, for --stream.  A file already
+  //  in that order is read straight through.  Otherwise, it is sorted in runs
+  //  that fit the buffer, each kept in a temporary file, and the runs are merged.
+  //  A run row is: key<tab>motif type number<tab>node<tab>node<tab>node
+  class SortedMotifs {
+  public:
+    SortedMotifs(const std::string& filename, std::size_t bufferBytes);
+
+    // false once there are no more
+    bool Next(Names& key, MotifType& motifType, NodeOrder& nodes);
+
+  private:
+    struct Run {
+      explicit Run(const std::string& path) : path_(path) {}
+      ~Run() { std::remove(path_.c_str()); }
+
+      bool Advance() {
+        if ( !std::getline(in_, row_) )
+          return false;
+        key_.assign(row_, 0, row_.find('\t'));
+        return true;
+      }
+
+      const std::string path_;
+      std::ifstream in_;
+      std::string row_, key_;
+    };
+
+    struct Later { // for a min-heap of runs_ indices
+      explicit Later(const std::vector< std::unique_ptr<Run> >& runs) : runs_(&runs) {}
+      bool operator()(std::size_t a, std::size_t b) const { return (*runs_)[a]->key_ > (*runs_)[b]->key_; }
+      const std::vector< std::unique_ptr<Run> >* runs_;
+    };
+
+    bool in_order();
+    void write_run(std::vector<std::string>& rows);
+    bool next_merged(Names& key, MotifType& motifType, NodeOrder& nodes);
+
+    const std::string filename_;
+    std::unique_ptr<MotifReader> reader_; // when the file is in order
+    std::vector< std::unique_ptr<Run> > runs_;
+    std::vector<std::size_t> heap_;
+    Names last_;
+    bool started_;
+  };
+
+  //=============
+  // TargetGraph
+  //=============
+  // The target as a raw edge list, for --target-graph: node ids and an open
+  //  addressing set of directed edges, so that any 3 nodes are classified with
+  //  6 lookups rather than by finding every motif of the graph
+  class TargetGraph {
+  public:
+    explicit TargetGraph(const std::string& filename);
+
+    // Motif type of the nodes labeled ref in the target, or NoMatch; trg gets
+    //  them in the order find_3node_motifs lists them
+    MotifType Classify(const std::string* const ref[3], const std::string* trg[3]) const;
+
+  private:
+    static const std::uint64_t Empty = ~std::uint64_t(0); // never a real edge: it is a self-edge
+    static std::size_t hash(std::uint64_t edge);
+    bool has_edge(std::uint32_t from, std::uint32_t to) const;
+
+    std::unordered_map<std::string, std::uint32_t> ids_;
+    std::vector<std::uint64_t> edges_; // from << 32 | to
+    std::size_t mask_;
+    MotifType types_[network_motifs::NumberOfInstanceTypes];
+  };
+
   // Fwd declarations
-  void motif_evolution(const NodeLookup& target,
-                       const NodeLookup& reference,
+  void graph_evolution(const TargetGraph& target,
+                       const NodeIds& ids,
+                       const Motifs& reference,
+                       Counts& counts,
+                       Printer* details);
+  void graph_evolution(const TargetGraph& target,
+                       SortedMotifs& reference,
                        Counts& counts,
-                       bool details);
-  void read_motifs(const std::string& filename,
-                   NodeLookup& lookup);
-  void spit_rhymes(Counts& counts);
+                       Printer* details);
+  void stream_evolution(SortedMotifs& target,
+                        SortedMotifs& reference,
+                        Counts& counts,
+                        Printer* details);
+  void batch_evolution(const std::vector<std::string>& files,
+                       unsigned int threads,
+                       Printer& out);
+  void spit_rhymes(Counts& counts, Printer& out);
 } // unnamed
 
 
@@ -134,15 +273,42 @@ namespace {
 int main(int argc, char** argv) {
   try {
     CheckArgs argcheck(argc, argv);
-    bool details = argcheck.Details();
-    NodeLookup target, reference;
-    read_motifs(argcheck.TargetFile(), target);
-    read_motifs(argcheck.ReferenceFile(), reference);
-
     Counts counts;
-    motif_evolution(target, reference, counts, details);
+    Printer out;
+    Printer* details = argcheck.Details() ? &out : nullptr;
+    if ( !argcheck.BatchFiles().empty() ) {
+      batch_evolution(argcheck.BatchFiles(), argcheck.Threads(), out);
+      out.Finish();
+      return EXIT_SUCCESS;
+    } else if ( argcheck.TargetGraph() ) {
+      TargetGraph target(argcheck.TargetFile());
+      if ( argcheck.Stream() ) {
+        SortedMotifs reference(argcheck.ReferenceFile(), argcheck.BufferBytes());
+        graph_evolution(target, reference, counts, details);
+      } else {
+        NodeIds ids;
+        Motifs reference(argcheck.ReferenceFile());
+        reference.Read(ids);
+        reference.Finish(ids.Sort());
+        graph_evolution(target, ids, reference, counts, details);
+      }
+    } else if ( argcheck.Stream() ) {
+      SortedMotifs target(argcheck.TargetFile(), argcheck.BufferBytes());
+      SortedMotifs reference(argcheck.ReferenceFile(), argcheck.BufferBytes());
+      stream_evolution(target, reference, counts, details);
+    } else {
+      NodeIds ids;
+      Motifs target(argcheck.TargetFile()), reference(argcheck.ReferenceFile());
+      target.Read(ids);
+      reference.Read(ids);
+      const std::vector<std::uint32_t> newIds = ids.Sort();
+      target.Finish(newIds);
+      reference.Finish(newIds);
+      motif_evolution(ids, target, reference, counts, details);
+    }
     if ( !details )
-      spit_rhymes(counts);
+      spit_rhymes(counts, out);
+    out.Finish();
     return EXIT_SUCCESS;
   } catch(Help& h) {
     std::cout << CheckArgs::Usage() << std::endl;
@@ -159,316 +325,369 @@ int main(int argc, char** argv) {
 
 
 namespace {
-  char const* get_name(MotifType m);
-  MotifType modified_motif_type(MotifType motifType);
-
   //===============
   // spit_rhymes()
   //===============
-  void spit_rhymes(Counts& counts) {
+  void spit_rhymes(Counts& counts, Printer& out) {
     // spit out an output matrix
+    matrix_header(out);
+    matrix_rows(counts, out, "");
+  }
 
-    // header
-    std::printf("Motif-Type");
-    for ( auto i = Vout; i < NumberOfBaseTypes; i = static_cast<MotifType>(i+1) )
-      std::printf("\t%s", get_name(i));
-    std::printf("\tNo-Match\tMatched-Variant\n");
-
-    // guts
-    MotifType diffType; // for cases when FFLs in both target/ref, but nodes rearranged
-    for ( auto i = Vout; i < NumberOfBaseTypes; i = static_cast<MotifType>(i+1) ) {
-      std::printf("%s", get_name(i));
-      try {
-        diffType = modified_motif_type(i);
-      } catch(std::string& s) {
-        diffType = NoMatch;
-      }
+  //=========
+  // names()
+  //=========
+  // A motif's nodes in sorted order, split by \0 so that comparing keys
+  //  compares labels in turn
+  Names names(const NodeOrder& nodes, const MotifReader& reader) {
+    if ( (nodes[0] == nodes[1]) || (nodes[0] == nodes[2]) || (nodes[1] == nodes[2]) )
+      throw("The same node found more than once in a 3-motif at " + reader.Where() + " in " + reader.FileName());
+
+    const std::string* a = &nodes[0];
+    const std::string* b = &nodes[1];
+    const std::string* c = &nodes[2];
+    if ( *b > *c )
+      std::swap(b, c);
+
+    if ( *a > *b ) {
+      std::swap(a, b);
+      if ( *b > *c )
+        std::swap(b, c);
+    }
+    Names key(*a);
+    key += '\0';
+    key += *b;
+    key += '\0';
+    return key += *c;
+  }
 
-      for ( auto j = Vout; j < NumberOfBaseTypes; j = static_cast<MotifType>(j+1) )
-        std::printf("\t%ld", counts[i][j]);
-      std::printf("\t%ld", counts[i][NoMatch]);
+  SortedMotifs::SortedMotifs(const std::string& filename, std::size_t bufferBytes)
+    : filename_(filename), started_(false) {
+    if ( in_order() ) {
+      reader_.reset(new MotifReader(filename));
+      return;
+    }
 
-      if ( diffType != NoMatch )
-        std::printf("\t%ld", counts[i][diffType]);
-      else
-        std::printf("\t0");
-      std::printf("\n");
+    MotifReader reader(filename);
+    MotifType motifType;
+    NodeOrder nodes;
+    std::vector<std::string> rows;
+    std::size_t used = 0;
+    while ( reader.Next(motifType, nodes) ) {
+      std::string row = names(nodes, reader);
+      row += '\t';
+      network_motifs::append_number(row, motifType);
+      for ( int i = 0; i < 3; ++i )
+        row += '\t' + nodes[i];
+      used += sizeof(row) + row.size();
+      rows.push_back(std::string());
+      rows.back().swap(row);
+      if ( used >= bufferBytes ) {
+        write_run(rows);
+        used = 0;
+      }
+    } // while
+    write_run(rows);
+
+    for ( std::size_t i = 0; i < runs_.size(); ++i ) {
+      runs_[i]->in_.open(runs_[i]->path_.c_str());
+      if ( runs_[i]->Advance() )
+        heap_.push_back(i);
     } // for
+    std::make_heap(heap_.begin(), heap_.end(), Later(runs_));
   }
 
-  //=======================
-  // modified_motif_type()
-  //=======================
-  MotifType modified_motif_type(MotifType motifType) {
-    switch (motifType) {
-      case FFL:
-        return FFL_diff;
-      case MutualAnd3Chain:
-        return MutualAnd3Chain_diff;
-      case MutualIn:
-        return MutualIn_diff;
-      case TreChain:
-        return TreChain_diff;
-      case SemiClique:
-        return SemiClique_diff;
-      case MutualOut:
-        return MutualOut_diff;
-      case Vout:
-        return Vout_diff;
-      case Vin:
-        return Vin_diff;
-      case RegulatingMutual:
-        return RegulatingMutual_diff;
-      case RegulatedMutual:
-        return RegulatedMutual_diff;
-      case MutualV:
-        return MutualV_diff;
-      default:
-        throw(std::string("Program Error: modified_motif_type()"));
-    };
+  // one pass over the file to see if it can be read as is
+  bool SortedMotifs::in_order() {
+    MotifReader reader(filename_);
+    MotifType motifType;
+    NodeOrder nodes;
+    Names last, key;
+    bool first = true;
+    while ( reader.Next(motifType, nodes) ) {
+      key = names(nodes, reader);
+      if ( !first && key <= last )
+        return false;
+      last.swap(key);
+      first = false;
+    } // while
+    return true;
+  }
+
+  void SortedMotifs::write_run(std::vector<std::string>& rows) {
+    if ( rows.empty() )
+      return;
+    std::sort(rows.begin(), rows.end(), [](const std::string& a, const std::string& b) {
+      return a.compare(0, a.find('\t'), b, 0, b.find('\t')) < 0;
+    });
+
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string((dir && *dir) ? dir : "/tmp") + "/motif3.XXXXXX";
+    const int fd = ::mkstemp(&path[0]);
+    if ( fd < 0 )
+      throw("Unable to create a temporary file in " + path.substr(0, path.rfind('/')));
+    ::close(fd);
+    runs_.push_back(std::unique_ptr<Run>(new Run(path)));
+
+    std::ofstream out(path.c_str());
+    for ( auto& r : rows )
+      out << r << '\n';
+    if ( !out.flush() )
+      throw("Unable to write temporary file: " + path);
+    rows.clear();
+  }
+
+  bool SortedMotifs::Next(Names& key, MotifType& motifType, NodeOrder& nodes) {
+    if ( reader_ ) {
+      if ( !reader_->Next(motifType, nodes) )
+        return false;
+      key = names(nodes, *reader_);
+    } else if ( !next_merged(key, motifType, nodes) ) {
+      return false;
+    }
+
+    if ( started_ && key == last_ )
+      throw("Multiple rows have the same nodes (" + nodes[0] + ", " + nodes[1] + ", " + nodes[2] + ") in " + filename_);
+    last_ = key;
+    started_ = true;
+    return true;
+  }
+
+  bool SortedMotifs::next_merged(Names& key, MotifType& motifType, NodeOrder& nodes) {
+    if ( heap_.empty() )
+      return false;
+    std::pop_heap(heap_.begin(), heap_.end(), Later(runs_));
+    Run& run = *runs_[heap_.back()];
+
+    // written by the constructor, so the columns are all there
+    const std::string& row = run.row_;
+    std::string::size_type p = row.find('\t') + 1, q = row.find('\t', p);
+    key = run.key_;
+    motifType = static_cast<MotifType>(std::atoi(row.c_str() + p));
+    nodes.resize(3);
+    for ( int i = 0; i < 3; ++i ) {
+      p = q + 1;
+      q = row.find('\t', p);
+      nodes[i].assign(row, p, (q == std::string::npos) ? q : q - p);
+    } // for
+
+    if ( run.Advance() )
+      std::push_heap(heap_.begin(), heap_.end(), Later(runs_));
+    else
+      heap_.pop_back();
+    return true;
   }
 
   //=============
-  // get_motif()
+  // TargetGraph
   //=============
-  MotifType get_motif(const std::string& name) {
-    if ( name == "Clique:" )
-      return Clique;
-    else if ( name == "FFL:")
-      return FFL;
-    else if ( name == "Mutual-And-3-Chain:" )
-      return MutualAnd3Chain;
-    else if ( name == "Mutual-In:" )
-      return MutualIn;
-    else if ( name == "Mutual-Out:" )
-      return MutualOut;
-    else if ( name == "Mutual-V:" )
-      return MutualV;
-    else if ( name == "Regulated-Mutual:" )
-      return RegulatedMutual;
-    else if ( name == "Regulating-Mutual:" )
-      return RegulatingMutual;
-    else if ( name == "Semi-Clique:" )
-      return SemiClique;
-    else if ( name == "3-Chain:" )
-      return TreChain;
-    else if ( name == "3-Loop:" )
-      return TreLoop;
-    else if ( name == "V-in:" )
-      return Vin;
-    else if ( name == "V-out:" )
-      return Vout;
-    else
-      throw("Unknown Motif Type: " + name);
+  TargetGraph::TargetGraph(const std::string& filename) {
+    network_motifs::MappedFile file(filename, "target file");
+    const char* next = file.Data();
+    const char* const end = next + file.Size();
+    std::vector<std::uint64_t> edges;
+    std::string label;
+    std::size_t rowid = 0;
+    while ( next < end ) {
+      ++rowid;
+      const char* eol = static_cast<const char*>(std::memchr(next, '\n', end - next));
+      if ( !eol )
+        eol = end;
+      const char* tab = static_cast<const char*>(std::memchr(next, '\t', eol - next));
+      if ( !tab ) {
+        std::stringstream conv; conv << rowid;
+        throw("No tab found at row: " + conv.str() + " in " + filename);
+      }
+      std::uint32_t ends[2];
+      for ( int i = 0; i < 2; ++i ) {
+        if ( i == 0 )
+          label.assign(next, tab);
+        else
+          label.assign(tab + 1, eol);
+        ends[i] = ids_.insert(std::make_pair(label, static_cast<std::uint32_t>(ids_.size()))).first->second;
+      } // for
+      if ( ends[0] != ends[1] ) // as in find_3node_motifs, self-edges are ignored
+        edges.push_back((static_cast<std::uint64_t>(ends[0]) << 32) | ends[1]);
+      next = eol + 1;
+    } // while
+
+    std::size_t size = 16;
+    while ( size < 2 * edges.size() )
+      size *= 2;
+    mask_ = size - 1;
+    edges_.assign(size, std::uint64_t(Empty));
+    for ( auto e : edges ) {
+      std::size_t slot = hash(e) & mask_;
+      while ( edges_[slot] != Empty && edges_[slot] != e )
+        slot = (slot + 1) & mask_;
+      edges_[slot] = e;
+    } // for
+
+    for ( int i = 0; i < network_motifs::NumberOfInstanceTypes; ++i )
+      types_[i] = get_motif(std::string(network_motifs::InstanceTypeNames[i]) + ":");
   }
 
-  //============
-  // get_name()
-  //============
-  char const* get_name(MotifType m) {
-    switch (m) {
-      case Clique:
-        return "Clique";
-      case FFL:
-        return "FFL";
-      case FFL_diff:
-        return "FFL-D";
-      case MutualAnd3Chain:
-        return "Mutual-And-3-Chain";
-      case MutualAnd3Chain_diff:
-        return "Mutual-And-3-Chain-D";
-      case MutualIn:
-        return "Mutual-In";
-      case MutualIn_diff:
-        return "Mutual-In-D";
-      case MutualOut:
-        return "Mutual-Out";
-      case MutualOut_diff:
-        return "Mutual-Out-D";
-      case MutualV:
-        return "Mutual-V";
-      case MutualV_diff:
-        return "Mutual-V-D";
-      case NoMatch:
-        return "No-3-Node-Motif";
-      case RegulatedMutual:
-        return "Regulated-Mutual";
-      case RegulatedMutual_diff:
-        return "Regulated-Mutual-D";
-      case RegulatingMutual:
-        return "Regulating-Mutual";
-      case RegulatingMutual_diff:
-        return "Regulating-Mutual-D";
-      case SemiClique:
-        return "Semi-Clique";
-      case SemiClique_diff:
-        return "Semi-Clique-D";
-      case TreChain:
-        return "3-Chain";
-      case TreChain_diff:
-        return "3-Chain-D";
-      case TreLoop:
-        return "3-Loop";
-      case Vin:
-        return "V-in";
-      case Vin_diff:
-        return "V-in-D";
-      case Vout:
-        return "V-out";
-      case Vout_diff:
-        return "V-out-D";
-      default:
-        throw(std::string("Program error: get_name()"));
-    };
+  MotifType TargetGraph::Classify(const std::string* const ref[3], const std::string* trg[3]) const {
+    using namespace network_motifs::triads;
+
+    // in label order, which is the order of their ids in find_3node_motifs
+    const std::string* n[3] = { ref[0], ref[1], ref[2] };
+    if ( *n[1] > *n[2] )
+      std::swap(n[1], n[2]);
+    if ( *n[0] > *n[1] ) {
+      std::swap(n[0], n[1]);
+      if ( *n[1] > *n[2] )
+        std::swap(n[1], n[2]);
+    }
+
+    std::uint32_t id[3];
+    for ( int i = 0; i < 3; ++i ) {
+      auto found = ids_.find(*n[i]);
+      if ( found == ids_.end() )
+        return NoMatch;
+      id[i] = found->second;
+    } // for
+
+    const unsigned int r01 = has_edge(id[0], id[1]) | (has_edge(id[1], id[0]) << 1);
+    const unsigned int r02 = has_edge(id[0], id[2]) | (has_edge(id[2], id[0]) << 1);
+    const unsigned int r12 = has_edge(id[1], id[2]) | (has_edge(id[2], id[1]) << 1);
+    const Triad& t = triadTable.entries[triad_code(r01, r02, r12)];
+    if ( t.type == NotConnected )
+      return NoMatch;
+    for ( int i = 0; i < 3; ++i )
+      trg[i] = n[t.order[i]];
+    return types_[t.type];
+  }
+
+  std::size_t TargetGraph::hash(std::uint64_t edge) {
+    edge *= 0x9E3779B97F4A7C15ULL;
+    return static_cast<std::size_t>(edge ^ (edge >> 29));
+  }
+
+  bool TargetGraph::has_edge(std::uint32_t from, std::uint32_t to) const {
+    const std::uint64_t e = (static_cast<std::uint64_t>(from) << 32) | to;
+    std::size_t slot = hash(e) & mask_;
+    while ( edges_[slot] != Empty ) {
+      if ( edges_[slot] == e )
+        return true;
+      slot = (slot + 1) & mask_;
+    } // while
+    return false;
   }
 
   //===================
-  // motif_evolution()
+  // graph_evolution()
   //===================
-  void motif_evolution(const NodeLookup& target,
-                       const NodeLookup& reference,
+  // motif_evolution() against a TargetGraph
+  void graph_evolution(const TargetGraph& target,
+                       const NodeIds& ids,
+                       const Motifs& reference,
                        Counts& counts,
-                       bool details) {
-
-    static const int hardcodeNetworkMotifSize = 3;
-    counts.clear();
-    for ( auto i = Vout; i < NumberOfBaseTypes; ) {
-      counts.insert(std::make_pair(i, std::vector<long>(static_cast<MotifType>(NumberOfTotalTypes), 0)));
-      i = static_cast<MotifType>(i+1);
+                       Printer* details) {
+
+    init_counts(counts);
+    const std::string* ref[3];
+    const std::string* trg[3];
+    for ( auto& r : reference.Instances() ) {
+      for ( int i = 0; i < 3; ++i )
+        ref[i] = &ids.Label(r.Listed(i));
+      const MotifType trgType = target.Classify(ref, trg);
+      map_motif(static_cast<MotifType>(r.type), ref, trgType, trg, counts, details);
     } // for
+  }
 
-    bool same = true;
-    for ( auto r : reference ) {
-      auto t = target.find(r.first);
-      if ( t != target.end() ) {
-        if ( t->second.first != r.second.first ) {
-          const NodeOrder& ref = r.second.second;
-          counts[r.second.first][t->second.first]++;
-          if ( details ) {
-            std::printf("%s", ref[0].c_str());
-            for ( int i = 1; i < hardcodeNetworkMotifSize; ++i )
-              std::printf("\t%s", ref[i].c_str());
-            std::printf("\t%s\t%s\n", get_name(r.second.first), get_name(t->second.first));
-          }
-        } else {
-          const NodeOrder& ref = r.second.second;
-          const NodeOrder& trg = t->second.second;
-          MotifType motifType = r.second.first;
-          if ( details ) {
-            std::printf("%s", ref[0].c_str());
-            for ( int i = 1; i < hardcodeNetworkMotifSize; ++i )
-              std::printf("\t%s", ref[i].c_str());
-          }
-
-          switch (motifType) {
-            case FFL: case MutualAnd3Chain: /* all order matters */
-            case MutualIn: case MutualOut:
-            case TreChain: case SemiClique:
-              same = true;
-              for ( int i = 0; i < hardcodeNetworkMotifSize; ++i ) {
-                if ( ref[i] != trg[i] ) {
-                  same = false;
-                  break;
-                }
-              } // for
-              if ( same ) {
-                counts[motifType][motifType]++;
-                if ( details )
-                  std::printf("\t%s\t%s\n", get_name(motifType), get_name(motifType));
-              } else {
-                counts[motifType][modified_motif_type(motifType)]++;
-                if ( details )
-                  std::printf("\t%s\tdiff-%s\n", get_name(motifType), get_name(motifType));
-              }
-              break;
-
-            /*
-            the next non-default case statements require detailed
-            knowledge of node order given by the find_3node_motifs program
-            turns out it's always a single node, and it's the first given
-            */
-            case Vout: case Vin: case MutualV:
-            case RegulatingMutual: case RegulatedMutual:
-              if ( ref[0] == trg[0] ) {
-                counts[motifType][motifType]++;
-                if ( details )
-                  std::printf("\t%s\t%s\n", get_name(motifType), get_name(motifType));
-              } else {
-                counts[motifType][modified_motif_type(motifType)]++;
-                if ( details )
-                  std::printf("\t%s\tdiff-%s\n", get_name(motifType), get_name(motifType));
-              }
-              break;
-
-            default:
-              counts[motifType][motifType]++;
-              if ( details )
-                std::printf("\t%s\t%s\n", get_name(motifType), get_name(motifType));
-          };
-        }
-      } else {
-        counts[r.second.first][NoMatch]++;
-        const NodeOrder& ref = r.second.second;
-        if ( details ) {
-          std::printf("%s", ref[0].c_str());
-          for ( int i = 1; i < hardcodeNetworkMotifSize; ++i )
-            std::printf("\t%s", ref[i].c_str());
-          std::printf("\t%s\tNo-Match\n", get_name(r.second.first));
+  void graph_evolution(const TargetGraph& target,
+                       SortedMotifs& reference,
+                       Counts& counts,
+                       Printer* details) {
+
+    init_counts(counts);
+    Names rkey;
+    MotifType rtype;
+    NodeOrder rnodes(3);
+    const std::string* const ref[3] = { &rnodes[0], &rnodes[1], &rnodes[2] };
+    const std::string* trg[3];
+    while ( reference.Next(rkey, rtype, rnodes) ) {
+      const MotifType trgType = target.Classify(ref, trg);
+      map_motif(rtype, ref, trgType, trg, counts, details);
+    } // while
+  }
+
+  //===================
+  // batch_evolution()
+  //===================
+  // motif_evolution() for every ordered pair of files; each file is read once,
+  //  and pairs are spread over threads
+  void batch_evolution(const std::vector<std::string>& files,
+                       unsigned int threads,
+                       Printer& out) {
+
+    NodeIds ids;
+    std::vector< std::unique_ptr<Motifs> > motifs;
+    for ( auto& f : files ) {
+      motifs.push_back(std::unique_ptr<Motifs>(new Motifs(f)));
+      motifs.back()->Read(ids);
+    } // for
+    const std::vector<std::uint32_t> newIds = ids.Sort();
+    for ( auto& m : motifs )
+      m->Finish(newIds);
+
+    const std::size_t k = files.size();
+    std::vector<Counts> counts(k * k); // target * k + reference
+    std::atomic<std::size_t> nextPair(0);
+    std::vector<std::thread> workers;
+    std::exception_ptr failure;
+    std::mutex failureLock;
+    for ( unsigned int t = 0; t < std::min<std::size_t>(threads, k * (k - 1)); ++t ) {
+      workers.push_back(std::thread([&] {
+        try {
+          for ( std::size_t p = nextPair++; p < k * k; p = nextPair++ ) {
+            if ( p / k != p % k )
+              motif_evolution(ids, *motifs[p / k], *motifs[p % k], counts[p]);
+          } // for
+        } catch(...) {
+          std::lock_guard<std::mutex> guard(failureLock);
+          failure = std::current_exception();
         }
-      }
+      }));
+    } // for
+    for ( auto& w : workers )
+      w.join();
+    if ( failure )
+      std::rethrow_exception(failure);
+
+    out << "Target\tReference\t";
+    matrix_header(out);
+    for ( std::size_t p = 0; p < k * k; ++p ) {
+      if ( p / k != p % k )
+        matrix_rows(counts[p], out, files[p / k] + '\t' + files[p % k] + '\t');
     } // for
   }
 
-  //===============
-  // read_motifs()
-  //===============
-  void read_motifs(const std::string& filename, NodeLookup& lookup) {
-    std::ifstream infile(filename.c_str());
-    ByLine bline;
-    std::size_t linecntr = 0;
-    while ( infile >> bline ) {
-      std::stringstream lineNum; lineNum << ++linecntr;
-      std::string::size_type p, q;
-      if ( bline.find("\t\t") != std::string::npos )
-        throw("Consecutive tabs found at line: " + lineNum.str() + " in " + filename);
-      else if ( bline.find(" ") != std::string::npos )
-        throw("Found 1 or more spaces at line: " + lineNum.str() + " in " + filename);
-
-      p = bline.find("\t");
-      if ( p == std::string::npos )
-        throw("No tabs at line: " + lineNum.str() + " in " + filename);
-      MotifType motifType = get_motif(bline.substr(0, p));
-      q = bline.find("\t", ++p);
-      if ( q == std::string::npos )
-        throw("No tab after second column at line: " + lineNum.str() + " in " + filename);
-      std::string firstNode = bline.substr(p, q-p);
-      p = bline.find("\t", ++q);
-      if ( p == std::string::npos )
-        throw("No tab after 3rd column at line: " + lineNum.str() + " in " + filename);
-      std::string secondNode = bline.substr(q, p-q);
-      std::string thirdNode = bline.substr(++p);
-      if ( thirdNode.empty() )
-        throw("Problem with 3rd column at line: " + lineNum.str() + " in " + filename);
-      else if ( thirdNode.find_first_of("\t") != std::string::npos )
-        throw("Tab found in what should be the 3rd column at line: " + lineNum.str() + " in " + filename);
-
-      if ( (firstNode == secondNode) || (firstNode == thirdNode) || (secondNode == thirdNode) )
-        throw("The same node found more than once in a 3-motif at line: " + lineNum.str() + " in " + filename);
-
-      std::string a = firstNode, b = secondNode, c = thirdNode;
-      if ( b > c )
-        std::swap(b, c);
-
-      if ( a > b ) {
-        std::swap(a, b);
-        if ( b > c )
-          std::swap(b, c);
-      }
-
-      NodeOrder nodes;
-      nodes.push_back(firstNode); nodes.push_back(secondNode); nodes.push_back(thirdNode);
-      if ( !lookup.insert(std::make_pair(a+b+c, std::make_pair(motifType, nodes))).second )
-        throw(std::string("Multiple rows have the same nodes. One is at line: " + lineNum.str() + " in " + filename));
+  //====================
+  // stream_evolution()
+  //====================
+  // motif_evolution() as a merge join of both files in key order
+  void stream_evolution(SortedMotifs& target,
+                        SortedMotifs& reference,
+                        Counts& counts,
+                        Printer* details) {
+
+    init_counts(counts);
+    Names tkey, rkey;
+    MotifType ttype, rtype;
+    NodeOrder tnodes(3), rnodes(3);
+    const std::string* const trg[3] = { &tnodes[0], &tnodes[1], &tnodes[2] };
+    const std::string* const ref[3] = { &rnodes[0], &rnodes[1], &rnodes[2] };
+    bool more = target.Next(tkey, ttype, tnodes);
+    while ( reference.Next(rkey, rtype, rnodes) ) {
+      while ( more && tkey < rkey )
+        more = target.Next(tkey, ttype, tnodes);
+      if ( more && tkey == rkey )
+        map_motif(rtype, ref, ttype, trg, counts, details);
+      else
+        map_motif(rtype, ref, NoMatch, nullptr, counts, details);
     } // while
   }
+
 } // unnamed
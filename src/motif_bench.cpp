@@ -0,0 +1,476 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+#include "motif_compare.hpp"
+#include "motif_graph.hpp"
+#include "motif_search.hpp"
+#include "output_writer.hpp"
+
+
+namespace {
+  using namespace network_motifs;
+
+  //============
+  // Generators
+  //============
+  // Random directed graphs as rows of labels.  Every node pair that is joined
+  //  is joined both ways with probability 'bidirectional'.
+  enum Generator { ErdosRenyi, PowerLaw, DenseReciprocal, NumberOfGenerators };
+
+  char const* const GeneratorNames[NumberOfGenerators] = { "erdos-renyi", "power-law", "dense-reciprocal" };
+
+  struct GraphSpec {
+    Generator kind;
+    Node nodes;
+    double degree; // mean out-degree, before bidirectional edges are added
+    double bidirectional;
+  };
+
+  typedef std::vector< std::pair<Node, Node> > EdgeList;
+
+  // ErdosRenyi: nodes*degree pairs, uniformly.  PowerLaw: the same number of
+  //  pairs with both ends drawn by weight (i+1)^(-1/(2.5-1)), giving a degree
+  //  tail of exponent 2.5.  DenseReciprocal: every pair with probability
+  //  degree/nodes.
+  EdgeList generate(const GraphSpec& spec, std::mt19937_64& rng) {
+    EdgeList edges;
+    std::uniform_real_distribution<double> coin(0, 1);
+    auto add = [&](Node a, Node b) {
+      if ( a == b )
+        return;
+      edges.push_back(std::make_pair(a, b));
+      if ( coin(rng) < spec.bidirectional )
+        edges.push_back(std::make_pair(b, a));
+    };
+
+    const std::uint64_t pairs = static_cast<std::uint64_t>(spec.nodes * spec.degree);
+    if ( spec.kind == ErdosRenyi ) {
+      std::uniform_int_distribution<Node> node(0, spec.nodes - 1);
+      for ( std::uint64_t i = 0; i < pairs; ++i )
+        add(node(rng), node(rng));
+    } else if ( spec.kind == PowerLaw ) {
+      std::vector<double> weight(spec.nodes);
+      for ( Node n = 0; n < spec.nodes; ++n )
+        weight[n] = std::pow(n + 1.0, -1 / 1.5);
+      std::discrete_distribution<Node> node(weight.begin(), weight.end());
+      for ( std::uint64_t i = 0; i < pairs; ++i )
+        add(node(rng), node(rng));
+    } else {
+      const double p = spec.degree / spec.nodes;
+      for ( Node a = 0; a < spec.nodes; ++a ) {
+        for ( Node b = a + 1; b < spec.nodes; ++b ) {
+          if ( coin(rng) < p ) {
+            if ( coin(rng) < 0.5 )
+              add(a, b);
+            else
+              add(b, a);
+          }
+        } // for
+      } // for
+    }
+    return edges;
+  }
+
+  // Rows of the edges, labeled n0, n1, ...
+  void write_rows(const EdgeList& edges, std::ostream& out) {
+    std::string text;
+    for ( auto& e : edges ) {
+      text.push_back('n'); network_motifs::append_number(text, e.first);
+      text.append("\tn"); network_motifs::append_number(text, e.second);
+      text.push_back('\n');
+      if ( text.size() >= (1 << 20) ) {
+        out << text;
+        text.clear();
+      }
+    } // for
+    out << text;
+  }
+
+  // The edges with a fraction of them swapped for new uniform random ones
+  EdgeList perturb(const EdgeList& edges, Node nodes, double fraction, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::uniform_int_distribution<Node> node(0, nodes - 1);
+    EdgeList changed;
+    for ( auto& e : edges ) {
+      if ( coin(rng) >= fraction )
+        changed.push_back(e);
+      else {
+        const Node a = node(rng), b = node(rng);
+        if ( a != b )
+          changed.push_back(std::make_pair(a, b));
+      }
+    } // for
+    return changed;
+  }
+
+  //=========
+  // Results
+  //=========
+  double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // One timed phase as a JSON object; instances < 0 when there are none
+  std::string phase_json(const std::string& name, double seconds, std::uint64_t edges, long long instances) {
+    std::stringstream json;
+    json << std::setprecision(6);
+    json << "{\"phase\": \"" << name << "\", \"seconds\": " << seconds;
+    if ( edges )
+      json << ", \"edges_per_second\": " << (seconds > 0 ? edges / seconds : 0);
+    if ( instances >= 0 ) {
+      json << ", \"instances\": " << instances;
+      json << ", \"instances_per_second\": " << (seconds > 0 ? instances / seconds : 0);
+    }
+    json << "}";
+    return json.str();
+  }
+
+  struct BenchArgs {
+    BenchArgs(int argc, char** argv);
+    static std::string Usage();
+
+    double scale;
+    double bidirectional; // < 0 for each generator's own
+    unsigned int threads;
+    unsigned long seed;
+    int generate; // a generator to write rows of, or -1
+  };
+
+  struct BenchHelp {};
+
+  std::string BenchArgs::Usage() {
+    std::string msg = "motif_bench [--scale <X>] [--bidirectional <F>] [--threads <N>] [--seed <S>]\n"
+                      "motif_bench --generate erdos-renyi|power-law|dense-reciprocal [--scale <X>] [--bidirectional <F>] [--seed <S>]";
+    msg += "\n\n  Times graph loading, each motif type, the full listing, a --single-pass listing, and";
+    msg += "\n  motif3_network_changes' reading and comparison of two motif files, on an Erdos-Renyi,";
+    msg += "\n  a power-law and a dense reciprocal random graph, and writes the results as JSON.";
+    msg += "\n  Listings go to /dev/null and the motif files to $TMPDIR (default /tmp).";
+    msg += "\n  --scale <X> multiplies the number of nodes of each graph (default 1)";
+    msg += "\n  --bidirectional <F> sets the fraction of joined node pairs joined both ways\n    (default 0.1, or 0.5 for dense-reciprocal)";
+    msg += "\n  --generate writes the rows of one graph to stdout instead";
+    return msg;
+  }
+
+  BenchArgs::BenchArgs(int argc, char** argv) : scale(1), bidirectional(-1), threads(1), seed(1), generate(-1) {
+    for ( int i = 1; i < argc; ++i ) {
+      const std::string next(argv[i]);
+      if ( next == "--help" || next == "-h" )
+        throw(BenchHelp());
+      if ( i + 1 >= argc )
+        throw(Usage() + "\nUnrecognized option: " + next);
+      std::stringstream conv(argv[++i]);
+      if ( next == "--generate" ) {
+        for ( int g = 0; g < NumberOfGenerators; ++g ) {
+          if ( conv.str() == GeneratorNames[g] )
+            generate = g;
+        } // for
+        if ( generate < 0 )
+          throw(Usage() + "\nUnknown generator: " + conv.str());
+      } else if ( next == "--scale" || next == "--bidirectional" ) {
+        double x = 0;
+        if ( !(conv >> x) || !conv.eof() || (next == "--scale" ? !(x > 0) : !(x >= 0 && x <= 1)) )
+          throw(Usage() + "\n" + next + (next == "--scale" ? " expects a positive number: " : " expects a number from 0 to 1: ") + argv[i]);
+        (next == "--scale" ? scale : bidirectional) = x;
+      } else if ( next == "--threads" || next == "--seed" ) {
+        unsigned long n = 0;
+        if ( conv.peek() == '-' || !(conv >> n) || !conv.eof() || (n == 0 && next == "--threads") )
+          throw(Usage() + "\n" + next + " expects a positive integer: " + argv[i]);
+        if ( next == "--threads" )
+          threads = static_cast<unsigned int>(n);
+        else
+          seed = n;
+      } else
+        throw(Usage() + "\nUnrecognized option: " + next);
+    } // for
+  }
+
+  GraphSpec graph_spec(Generator kind, const BenchArgs& args) {
+    GraphSpec spec;
+    spec.kind = kind;
+    // a dense graph joins 40% of its node pairs, so most of its nodes get hub
+    //  rows and its lists are long enough for the SIMD kernels; its motifs grow
+    //  with the cube of its nodes, so it has few
+    const double nodes = (kind == DenseReciprocal) ? 250 : 20000;
+    spec.nodes = static_cast<Node>(std::max(3.0, nodes * args.scale));
+    spec.degree = (kind == DenseReciprocal) ? spec.nodes * 0.4 : (kind == PowerLaw) ? 4 : 8;
+    spec.bidirectional = (args.bidirectional >= 0) ? args.bidirectional : (kind == DenseReciprocal) ? 0.5 : 0.1;
+    return spec;
+  }
+
+  //=========
+  // Listing
+  //=========
+  // Rows as find_3node_motifs writes them, to fd.  Each thread fills a buffer
+  //  of its own and hands over whole rows, so rows are not interleaved but
+  //  their order depends on the threads.
+  class Lister {
+  public:
+    Lister(const Graph& graph, int fd) : graph_(&graph), fd_(fd) {}
+
+    void operator()(MotifType type, Node a, Node b, Node c) {
+      text_.append(MotifNames[type]);
+      text_.append(":\t"); append_label(a);
+      text_.push_back('\t'); append_label(b);
+      text_.push_back('\t'); append_label(c);
+      text_.push_back('\n');
+      if ( text_.size() >= (1 << 20) )
+        Flush();
+    }
+
+    void Flush();
+
+  private:
+    void append_label(Node n) {
+      text_.append(graph_->NodeLabels().Data(n), graph_->NodeLabels().Length(n));
+    }
+
+    const Graph* graph_;
+    int fd_;
+    std::string text_;
+  };
+
+  std::mutex& write_lock() {
+    static std::mutex lock;
+    return lock;
+  }
+
+  void Lister::Flush() {
+    std::lock_guard<std::mutex> guard(write_lock());
+    std::size_t done = 0;
+    while ( done < text_.size() ) {
+      const ssize_t n = ::write(fd_, text_.data() + done, text_.size() - done);
+      if ( n < 0 )
+        throw(std::string("Unable to write motifs"));
+      done += static_cast<std::size_t>(n);
+    } // while
+    text_.clear();
+  }
+
+  // Run pass(first, last, census, lister) over runs of nodes on 'threads'
+  //  threads, listing to fd; returns the census of all runs
+  template <typename Pass>
+  Census list_motifs(const Graph& graph, unsigned int threads, int fd, Pass pass) {
+    const Node numNodes = graph.NumberOfNodes();
+    const Node run = std::max<Node>(1, numNodes / (64 * threads)); // small enough to even out hubs
+    std::atomic<Node> next(0);
+    std::vector<Census> censuses(threads, Census(NumberOfMotifTypes, 0));
+    std::vector<std::thread> workers;
+    std::exception_ptr failure;
+    std::mutex failureLock;
+    for ( unsigned int t = 0; t < threads; ++t ) {
+      workers.push_back(std::thread([&, t] {
+        try {
+          Lister lister(graph, fd);
+          for ( Node first = next.fetch_add(run); first < numNodes; first = next.fetch_add(run) )
+            pass(first, std::min<Node>(numNodes, first + run), censuses[t], lister);
+          lister.Flush();
+        } catch(...) {
+          std::lock_guard<std::mutex> guard(failureLock);
+          failure = std::current_exception();
+        }
+      }));
+    } // for
+    for ( auto& w : workers )
+      w.join();
+    if ( failure )
+      std::rethrow_exception(failure);
+
+    Census census(NumberOfMotifTypes, 0);
+    for ( auto& c : censuses ) {
+      for ( int m = 0; m < NumberOfMotifTypes; ++m )
+        census[m] += c[m];
+    } // for
+    return census;
+  }
+
+  // every motif of the given types, one type after another
+  Census list_types(const Graph& graph, const std::vector<MotifType>& types, unsigned int threads, int fd) {
+    Census census(NumberOfMotifTypes, 0);
+    for ( auto type : types ) {
+      census[type] = list_motifs(graph, threads, fd, [&graph, type](Node first, Node last, Census& c, Lister& lister) {
+        c[type] += find_instances(graph, type, first, last, lister);
+      })[type];
+    } // for
+    return census;
+  }
+
+  long long total(const Census& census) {
+    Count sum = 0;
+    for ( auto c : census )
+      sum += c;
+    return static_cast<long long>(sum);
+  }
+
+  std::string temporary_path() {
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string((dir && *dir) ? dir : "/tmp") + "/motif_bench.XXXXXX";
+    const int fd = ::mkstemp(&path[0]);
+    if ( fd < 0 )
+      throw("Unable to create a temporary file in " + path.substr(0, path.rfind('/')));
+    ::close(fd);
+    return path;
+  }
+
+  // A graph read as find_3node_motifs reads it, with its default hub rows
+  void read_graph(const std::string& path, Graph& graph) {
+    MappedFile file(path, "input file");
+    graph.Read(file);
+    graph.BuildHubs(Graph::DefaultHubDegree(graph.NumberOfNodes()));
+  }
+
+  // Time every phase on one graph; returns its JSON object
+  std::string bench_graph(const GraphSpec& spec, const BenchArgs& args, std::mt19937_64& rng) {
+    const EdgeList edges = generate(spec, rng);
+    const std::string graphFile = temporary_path(), changedFile = temporary_path();
+    const std::string targetMotifs = temporary_path(), referenceMotifs = temporary_path();
+    std::vector<std::string> phases;
+    std::stringstream head;
+    try {
+      {
+        std::ofstream out(graphFile.c_str());
+        write_rows(edges, out);
+        std::ofstream changed(changedFile.c_str());
+        write_rows(perturb(edges, spec.nodes, 0.05, rng), changed);
+        if ( !out.flush() || !changed.flush() )
+          throw(std::string("Unable to write a temporary graph file"));
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      Graph graph;
+      read_graph(graphFile, graph);
+      const std::uint64_t numEdges = graph.UnidirectionalOutputEdges().NumberOfEdges() + graph.AllBidirectionalEdges().NumberOfEdges();
+      phases.push_back(phase_json("load", seconds_since(start), numEdges, -1));
+
+      head << "{\"generator\": \"" << GeneratorNames[spec.kind] << "\", \"nodes\": " << graph.NumberOfNodes()
+           << ", \"edges\": " << numEdges << ", \"bidirectional_edges\": " << graph.BidirectionalEdges().NumberOfEdges()
+           << ", \"hubs\": " << graph.Hubs().NumberOfHubs()
+           << ", \"bidirectional_fraction\": " << spec.bidirectional;
+
+      const int devNull = ::open("/dev/null", O_WRONLY);
+      if ( devNull < 0 )
+        throw(std::string("Unable to open /dev/null"));
+      std::vector<MotifType> all;
+      for ( int m = 0; m < NumberOfMotifTypes; ++m ) {
+        all.push_back(static_cast<MotifType>(m));
+        start = std::chrono::steady_clock::now();
+        const Census census = list_types(graph, std::vector<MotifType>(1, all.back()), args.threads, devNull);
+        phases.push_back(phase_json(MotifNames[m], seconds_since(start), numEdges, total(census)));
+      } // for
+      start = std::chrono::steady_clock::now();
+      Census census = list_types(graph, all, args.threads, devNull);
+      phases.push_back(phase_json("all_types", seconds_since(start), numEdges, total(census)));
+      {
+        start = std::chrono::steady_clock::now();
+        Adjacency adjacency(graph);
+        census = list_motifs(graph, args.threads, devNull, [&adjacency](Node first, Node last, Census& c, Lister& lister) {
+          single_pass(adjacency, first, last, c, lister);
+        });
+        phases.push_back(phase_json("single_pass", seconds_since(start), numEdges, total(census)));
+      }
+      ::close(devNull);
+
+      // motif files of the graph and its perturbed copy, compared as target
+      //  and reference
+      const int targetFd = ::open(targetMotifs.c_str(), O_WRONLY | O_TRUNC);
+      if ( targetFd < 0 )
+        throw("Unable to write temporary file: " + targetMotifs);
+      list_types(graph, all, args.threads, targetFd);
+      ::close(targetFd);
+      {
+        Graph changed;
+        read_graph(changedFile, changed);
+        const int referenceFd = ::open(referenceMotifs.c_str(), O_WRONLY | O_TRUNC);
+        if ( referenceFd < 0 )
+          throw("Unable to write temporary file: " + referenceMotifs);
+        list_types(changed, all, args.threads, referenceFd);
+        ::close(referenceFd);
+      }
+
+      start = std::chrono::steady_clock::now();
+      changes::NodeIds ids;
+      changes::Motifs target(targetMotifs), reference(referenceMotifs);
+      target.Read(ids);
+      reference.Read(ids);
+      const std::vector<std::uint32_t> newIds = ids.Sort();
+      target.Finish(newIds);
+      reference.Finish(newIds);
+      const long long instances = static_cast<long long>(target.Instances().size() + reference.Instances().size());
+      phases.push_back(phase_json("read_motifs", seconds_since(start), 0, instances));
+
+      start = std::chrono::steady_clock::now();
+      changes::Counts counts;
+      changes::motif_evolution(ids, target, reference, counts);
+      phases.push_back(phase_json("motif_evolution", seconds_since(start), 0, instances));
+    } catch(...) {
+      for ( auto& p : { graphFile, changedFile, targetMotifs, referenceMotifs } )
+        std::remove(p.c_str());
+      throw;
+    }
+    for ( auto& p : { graphFile, changedFile, targetMotifs, referenceMotifs } )
+      std::remove(p.c_str());
+
+    std::string json = head.str() + ",\n     \"phases\": [\n";
+    for ( std::size_t i = 0; i < phases.size(); ++i )
+      json += "       " + phases[i] + (i + 1 < phases.size() ? ",\n" : "\n");
+    return json + "     ]}";
+  }
+} // unnamed
+
+
+//========
+// main()
+//========
+int main(int argc, char** argv) {
+  try {
+    BenchArgs args(argc, argv);
+    std::mt19937_64 rng(args.seed);
+    if ( args.generate >= 0 ) {
+      write_rows(generate(graph_spec(static_cast<Generator>(args.generate), args), rng), std::cout);
+      return EXIT_SUCCESS;
+    }
+
+    std::cout << "{\"threads\": " << args.threads << ", \"seed\": " << args.seed << ", \"scale\": " << args.scale
+              << ",\n \"graphs\": [\n";
+    for ( int g = 0; g < NumberOfGenerators; ++g ) {
+      std::cout << "    " << bench_graph(graph_spec(static_cast<Generator>(g), args), args, rng)
+                << (g + 1 < NumberOfGenerators ? ",\n" : "\n") << std::flush;
+    } // for
+    std::cout << " ]}" << std::endl;
+    return EXIT_SUCCESS;
+  } catch(BenchHelp& h) {
+    std::cout << BenchArgs::Usage() << std::endl;
+    return EXIT_SUCCESS;
+  } catch(std::string& s) {
+    std::cerr << s << std::endl;
+  } catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+  } catch(...) {
+    std::cerr << "Uknown exception" << std::endl;
+  }
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace {
+  struct Help {};
+
+  std::string usage() {
+    std::string msg = "motif_client <path>";
+    msg += "\n\n  Sends each line of stdin as a request to the motif_server listening on the Unix domain";
+    msg += "\n  socket <path>, and writes each response to stdout, ending in an empty line";
+    return msg;
+  }
+
+  int connect_to(const std::string& path);
+  bool send_line(int fd, const std::string& line);
+} // unnamed
+
+
+//========
+// main()
+//========
+int main(int argc, char** argv) {
+  try {
+    for ( int i = 1; i < argc; ++i ) {
+      if ( std::string(argv[i]) == "--help" || std::string(argv[i]) == "-h" )
+        throw(Help());
+    } // for
+    if ( argc != 2 )
+      throw(usage());
+
+    const int fd = connect_to(argv[1]);
+    std::string line, response;
+    char chunk[1 << 16];
+    while ( std::getline(std::cin, line) ) {
+      if ( line.find_first_not_of(" \t\r") == std::string::npos ) // no request, so no response
+        continue;
+      if ( !send_line(fd, line) )
+        throw(std::string("Connection to the server was lost"));
+
+      // a response ends with an empty line; quit gets none
+      response.clear();
+      bool passed = false; // some of it already went to stdout
+      while ( (passed || response != "\n") && (response.size() < 2 || response.compare(response.size() - 2, 2, "\n\n") != 0) ) {
+        const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if ( n < 0 && errno == EINTR )
+          continue;
+        if ( n <= 0 ) {
+          std::cout << response << std::flush;
+          ::close(fd);
+          return EXIT_SUCCESS;
+        }
+        response.append(chunk, static_cast<std::size_t>(n));
+        if ( response.size() >= (1 << 20) ) { // long listings pass straight through
+          std::cout.write(response.data(), response.size() - 1);
+          response.erase(0, response.size() - 1);
+          passed = true;
+        }
+      } // while
+      std::cout << response << std::flush;
+    } // while
+    ::close(fd);
+    return EXIT_SUCCESS;
+  } catch(Help& h) {
+    std::cout << usage() << std::endl;
+    return EXIT_SUCCESS;
+  } catch(std::string& s) {
+    std::cerr << s << std::endl;
+  } catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+  } catch(...) {
+    std::cerr << "Uknown exception" << std::endl;
+  }
+  return EXIT_FAILURE;
+}
+
+
+namespace {
+  int connect_to(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if ( path.size() >= sizeof(addr.sun_path) )
+      throw("Socket path is too long: " + path);
+    std::strcpy(addr.sun_path, path.c_str());
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 )
+      throw("Unable to connect to a motif_server at: " + path);
+    return fd;
+  }
+
+  bool send_line(int fd, const std::string& line) {
+    const std::string text = line + "\n";
+    std::size_t done = 0;
+    while ( done < text.size() ) {
+      const ssize_t n = ::write(fd, text.data() + done, text.size() - done);
+      if ( n < 0 && errno == EINTR )
+        continue;
+      if ( n < 0 )
+        return false;
+      done += static_cast<std::size_t>(n);
+    } // while
+    return true;
+  }
+} // unnamed
@@ -0,0 +1,705 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#ifndef NETWORK_MOTIFS_MOTIF_COMPARE_HPP
+#define NETWORK_MOTIFS_MOTIF_COMPARE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "motif_graph.hpp"
+#include "motif_instances.hpp"
+
+namespace network_motifs {
+namespace changes {
+
+  //===============
+  // Motif changes
+  //===============
+  // How the motifs listed by find_3node_motifs for one graph map onto those of
+  //  another, as motif3_network_changes reports it.  Its motif types add, to
+  //  the 13 base types, a variant of each whose nodes play other roles.
+  enum MotifType {
+    Vout = 0, Vin, TreChain, MutualIn, MutualOut, MutualV, FFL, TreLoop, RegulatedMutual,
+    RegulatingMutual, MutualAnd3Chain, SemiClique, Clique,
+
+    /* guys with a single node whose position is important */
+    Vout_diff, Vin_diff,
+
+    /* guys where every node's position matters */
+    TreChain_diff, MutualIn_diff, MutualOut_diff, FFL_diff,
+
+    /* more guys with a single node whose position is important */
+    RegulatingMutual_diff, RegulatedMutual_diff, MutualV_diff,
+
+    /* more guys where every node's position matters */
+    MutualAnd3Chain_diff, SemiClique_diff,
+
+    /* no 3-node motif in target set */
+    NoMatch,
+
+    NumberOfBaseTypes = 13, NumberOfTotalTypes = 25
+  };
+
+  typedef std::vector<std::string> NodeOrder; // Actual node order; only matters for some motif types
+
+  // A node label in place in an input file
+  struct LabelSpan {
+    const char* data;
+    std::size_t size;
+  };
+
+  typedef std::map< MotifType, std::vector<long> > Counts;
+
+  char const* get_name(MotifType m);
+  MotifType get_motif(const std::string& name);
+  MotifType get_motif(const char* name, std::size_t n);
+  MotifType modified_motif_type(MotifType motifType);
+
+  //=============
+  // MotifReader
+  //=============
+  // The motifs of a find_3node_motifs output file, text or --binary, in file order
+  class MotifReader {
+  public:
+    explicit MotifReader(const std::string& filename);
+
+    // false once there are no more
+    bool Next(MotifType& motifType, NodeOrder& nodes);
+    // the same, with each label in place in a text file
+    bool Next(MotifType& motifType, LabelSpan nodes[3]);
+    // where the last motif was found, for messages
+    std::string Where() const;
+    const std::string& FileName() const { return filename_; }
+    bool Binary() const { return binary_; }
+
+    // A binary file's own labels, which its records give by index: Next() of
+    //  a binary file can hand out those indices instead of copies of labels
+    std::uint32_t FileLabels() const { return static_cast<std::uint32_t>(offsets_.size() - 1); }
+    LabelSpan FileLabel(std::uint32_t n) const {
+      LabelSpan label = { labelText_ + offsets_[n], static_cast<std::size_t>(offsets_[n+1] - offsets_[n]) };
+      return label;
+    }
+    bool Next(MotifType& motifType, std::uint32_t nodes[3]);
+
+  private:
+    void next_text(MotifType& motifType, LabelSpan nodes[3]);
+
+    const std::string filename_;
+    MappedFile file_;
+    bool binary_;
+    std::size_t count_; // lines or records read
+    const char* next_;
+    const char* end_;
+    std::vector<std::uint64_t> offsets_; // of the labels of a binary file, in labelText_
+    const char* labelText_;
+    MotifType types_[NumberOfInstanceTypes];
+  };
+
+  //=========
+  // NodeIds
+  //=========
+  // Node labels of both input files, interned so that a motif is three integers.
+  //  Labels are looked up in place in the files; only new ones are copied.
+  class NodeIds {
+  public:
+    NodeIds() : dictionary_(labels_) {}
+
+    std::uint32_t Id(const char* label, std::size_t n) {
+      return dictionary_.Intern(label, n, Dictionary::Hash(label, n));
+    }
+    const std::string& Label(std::uint32_t id) const { return labels_[id]; }
+    std::size_t Size() const { return labels_.size(); }
+
+    // ids are handed out as labels are first seen; this renumbers them in
+    //  label order and returns the new id of each old one
+    std::vector<std::uint32_t> Sort();
+
+  private:
+    NodeIds(const NodeIds&); // not copyable
+    NodeIds& operator=(const NodeIds&);
+
+    std::vector<std::string> labels_;
+    Dictionary dictionary_; // over labels_
+  };
+
+  //==========
+  // Instance
+  //==========
+  // One motif: its node ids in increasing order (the lookup key), and the
+  //  order the nodes are listed in, as an index into Orders
+  struct Instance {
+    std::uint32_t nodes[3];
+    std::uint8_t type; // MotifType
+    std::uint8_t order;
+
+    std::uint32_t Listed(int i) const;
+    bool SameNodes(const Instance& other) const {
+      return nodes[0] == other.nodes[0] && nodes[1] == other.nodes[1] && nodes[2] == other.nodes[2];
+    }
+  };
+
+  const std::uint8_t Orders[6][3] = { {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0} };
+
+  inline std::uint32_t Instance::Listed(int i) const { return nodes[Orders[order][i]]; }
+
+  //========
+  // Motifs
+  //========
+  // The motifs of one input file in order of their nodes' labels, with an open
+  //  addressing index on their nodes
+  class Motifs {
+  public:
+    explicit Motifs(const std::string& filename) : filename_(filename), binary_(false) {}
+
+    // read the file; node ids are as given out by ids until Finish() is
+    //  called with the result of ids.Sort()
+    void Read(NodeIds& ids);
+    void Finish(const std::vector<std::uint32_t>& newIds);
+
+    // the motif on the nodes of key, or null
+    const Instance* Find(const Instance& key) const;
+    const std::vector<Instance>& Instances() const { return instances_; }
+    const std::string& FileName() const { return filename_; }
+
+  private:
+    static std::size_t hash(const Instance& m);
+    void index(bool check);
+
+    const std::string filename_;
+    bool binary_;
+    std::vector<Instance> instances_;
+    std::vector<std::uint32_t> slots_; // indices into instances_
+    std::size_t mask_;
+  };
+
+  //=======================
+  // modified_motif_type()
+  //=======================
+  inline MotifType modified_motif_type(MotifType motifType) {
+    switch (motifType) {
+      case FFL:
+        return FFL_diff;
+      case MutualAnd3Chain:
+        return MutualAnd3Chain_diff;
+      case MutualIn:
+        return MutualIn_diff;
+      case TreChain:
+        return TreChain_diff;
+      case SemiClique:
+        return SemiClique_diff;
+      case MutualOut:
+        return MutualOut_diff;
+      case Vout:
+        return Vout_diff;
+      case Vin:
+        return Vin_diff;
+      case RegulatingMutual:
+        return RegulatingMutual_diff;
+      case RegulatedMutual:
+        return RegulatedMutual_diff;
+      case MutualV:
+        return MutualV_diff;
+      default:
+        throw(std::string("Program Error: modified_motif_type()"));
+    };
+  }
+
+  //=============
+  // get_motif()
+  //=============
+  inline MotifType get_motif(const char* name, std::size_t n) {
+    static const char* const names[] = { "Clique:", "FFL:", "Mutual-And-3-Chain:", "Mutual-In:", "Mutual-Out:",
+                                         "Mutual-V:", "Regulated-Mutual:", "Regulating-Mutual:", "Semi-Clique:",
+                                         "3-Chain:", "3-Loop:", "V-in:", "V-out:" };
+    static const MotifType types[] = { Clique, FFL, MutualAnd3Chain, MutualIn, MutualOut,
+                                       MutualV, RegulatedMutual, RegulatingMutual, SemiClique,
+                                       TreChain, TreLoop, Vin, Vout };
+    for ( int i = 0; i < NumberOfBaseTypes; ++i ) {
+      if ( std::strlen(names[i]) == n && std::memcmp(names[i], name, n) == 0 )
+        return types[i];
+    } // for
+    throw("Unknown Motif Type: " + std::string(name, n));
+  }
+
+  inline MotifType get_motif(const std::string& name) {
+    return get_motif(name.data(), name.size());
+  }
+
+  //============
+  // get_name()
+  //============
+  inline char const* get_name(MotifType m) {
+    switch (m) {
+      case Clique:
+        return "Clique";
+      case FFL:
+        return "FFL";
+      case FFL_diff:
+        return "FFL-D";
+      case MutualAnd3Chain:
+        return "Mutual-And-3-Chain";
+      case MutualAnd3Chain_diff:
+        return "Mutual-And-3-Chain-D";
+      case MutualIn:
+        return "Mutual-In";
+      case MutualIn_diff:
+        return "Mutual-In-D";
+      case MutualOut:
+        return "Mutual-Out";
+      case MutualOut_diff:
+        return "Mutual-Out-D";
+      case MutualV:
+        return "Mutual-V";
+      case MutualV_diff:
+        return "Mutual-V-D";
+      case NoMatch:
+        return "No-3-Node-Motif";
+      case RegulatedMutual:
+        return "Regulated-Mutual";
+      case RegulatedMutual_diff:
+        return "Regulated-Mutual-D";
+      case RegulatingMutual:
+        return "Regulating-Mutual";
+      case RegulatingMutual_diff:
+        return "Regulating-Mutual-D";
+      case SemiClique:
+        return "Semi-Clique";
+      case SemiClique_diff:
+        return "Semi-Clique-D";
+      case TreChain:
+        return "3-Chain";
+      case TreChain_diff:
+        return "3-Chain-D";
+      case TreLoop:
+        return "3-Loop";
+      case Vin:
+        return "V-in";
+      case Vin_diff:
+        return "V-in-D";
+      case Vout:
+        return "V-out";
+      case Vout_diff:
+        return "V-out-D";
+      default:
+        throw(std::string("Program error: get_name()"));
+    };
+  }
+
+  inline MotifReader::MotifReader(const std::string& filename)
+    : filename_(filename), file_(filename), binary_(false), count_(0),
+      next_(file_.Data()), end_(file_.Data() + file_.Size()), offsets_(1, 0), labelText_(nullptr) {
+    if ( file_.Size() < sizeof(InstanceHeader) || std::memcmp(file_.Data(), InstanceMagic, sizeof(InstanceMagic)) != 0 )
+      return;
+
+    // Motifs written by find_3node_motifs --binary; see motif_instances.hpp
+    binary_ = true;
+    InstanceHeader header;
+    std::memcpy(&header, file_.Data(), sizeof(header));
+    if ( header.version != InstanceVersion )
+      throw("Unsupported binary motif file version in " + filename);
+
+    const std::uint64_t offsetBytes = (static_cast<std::uint64_t>(header.numNodes) + 1) * sizeof(std::uint64_t);
+    const std::uint64_t start = sizeof(header) + offsetBytes + ((header.labelBytes + 7) & ~std::uint64_t(7));
+    if ( start > file_.Size() || (file_.Size() - start) % sizeof(InstanceRecord) != 0 )
+      throw("Binary motif file is damaged: " + filename);
+
+    offsets_.resize(header.numNodes + 1);
+    std::memcpy(offsets_.data(), file_.Data() + sizeof(header), offsetBytes);
+    labelText_ = file_.Data() + sizeof(header) + offsetBytes;
+    for ( std::uint32_t n = 0; n < header.numNodes; ++n ) {
+      if ( offsets_[n] > offsets_[n+1] || offsets_[n+1] > header.labelBytes )
+        throw("Binary motif file is damaged: " + filename);
+    } // for
+
+    for ( int i = 0; i < NumberOfInstanceTypes; ++i )
+      types_[i] = get_motif(std::string(InstanceTypeNames[i]) + ":");
+    next_ = file_.Data() + start;
+  }
+
+  inline bool MotifReader::Next(MotifType& motifType, NodeOrder& nodes) {
+    LabelSpan labels[3];
+    if ( !Next(motifType, labels) )
+      return false;
+    nodes.resize(3);
+    for ( int i = 0; i < 3; ++i )
+      nodes[i].assign(labels[i].data, labels[i].size);
+    return true;
+  }
+
+  inline bool MotifReader::Next(MotifType& motifType, LabelSpan nodes[3]) {
+    if ( !binary_ ) {
+      if ( next_ >= end_ )
+        return false;
+      ++count_;
+      next_text(motifType, nodes);
+      return true;
+    }
+
+    std::uint32_t ids[3];
+    if ( !Next(motifType, ids) )
+      return false;
+    for ( int i = 0; i < 3; ++i )
+      nodes[i] = FileLabel(ids[i]);
+    return true;
+  }
+
+  inline bool MotifReader::Next(MotifType& motifType, std::uint32_t nodes[3]) {
+    if ( next_ >= end_ )
+      return false;
+    ++count_;
+    InstanceRecord record;
+    std::memcpy(&record, next_, sizeof(record));
+    next_ += sizeof(record);
+    if ( record.type >= static_cast<std::uint32_t>(NumberOfInstanceTypes) )
+      throw("Unknown Motif Type at " + Where() + " in " + filename_);
+    const std::uint32_t numLabels = FileLabels();
+    if ( record.nodes[0] >= numLabels || record.nodes[1] >= numLabels || record.nodes[2] >= numLabels )
+      throw("Unknown node at " + Where() + " in " + filename_);
+    nodes[0] = record.nodes[0];
+    nodes[1] = record.nodes[1];
+    nodes[2] = record.nodes[2];
+    motifType = types_[record.type];
+    return true;
+  }
+
+  inline std::string MotifReader::Where() const {
+    return (binary_ ? "record: " : "line: ") + std::to_string(count_);
+  }
+
+  inline void MotifReader::next_text(MotifType& motifType, LabelSpan nodes[3]) {
+    const char* const line = next_;
+    const char* eol = static_cast<const char*>(std::memchr(line, '\n', end_ - line));
+    if ( !eol )
+      eol = end_;
+    next_ = eol + 1;
+
+    // one scan finds the first 3 tabs and anything out of place
+    const char* tab[3] = { nullptr, nullptr, nullptr };
+    int tabs = 0;
+    bool doubled = false, space = false;
+    for ( const char* c = line; c < eol; ++c ) {
+      if ( *c == '\t' ) {
+        doubled = doubled || (c > line && c[-1] == '\t');
+        if ( tabs < 3 )
+          tab[tabs] = c;
+        ++tabs;
+      } else if ( *c == ' ' ) {
+        space = true;
+      }
+    } // for
+
+    if ( doubled )
+      throw("Consecutive tabs found at " + Where() + " in " + filename_);
+    else if ( space )
+      throw("Found 1 or more spaces at " + Where() + " in " + filename_);
+
+    if ( tabs == 0 )
+      throw("No tabs at " + Where() + " in " + filename_);
+    motifType = get_motif(line, tab[0] - line);
+    if ( tabs == 1 )
+      throw("No tab after second column at " + Where() + " in " + filename_);
+    nodes[0].data = tab[0] + 1;
+    nodes[0].size = tab[1] - tab[0] - 1;
+    if ( tabs == 2 )
+      throw("No tab after 3rd column at " + Where() + " in " + filename_);
+    nodes[1].data = tab[1] + 1;
+    nodes[1].size = tab[2] - tab[1] - 1;
+    nodes[2].data = tab[2] + 1;
+    nodes[2].size = eol - tab[2] - 1;
+    if ( nodes[2].size == 0 )
+      throw("Problem with 3rd column at " + Where() + " in " + filename_);
+    else if ( tabs > 3 )
+      throw("Tab found in what should be the 3rd column at " + Where() + " in " + filename_);
+  }
+
+  //=========
+  // NodeIds
+  //=========
+  inline std::vector<std::uint32_t> NodeIds::Sort() {
+    std::vector<std::uint32_t> byLabel(labels_.size());
+    for ( std::uint32_t i = 0; i < byLabel.size(); ++i )
+      byLabel[i] = i;
+    std::sort(byLabel.begin(), byLabel.end(), [this](std::uint32_t a, std::uint32_t b) {
+      return labels_[a] < labels_[b];
+    });
+
+    std::vector<std::uint32_t> newIds(labels_.size());
+    std::vector<std::string> labels(labels_.size());
+    for ( std::uint32_t i = 0; i < byLabel.size(); ++i ) {
+      newIds[byLabel[i]] = i;
+      labels[i].swap(labels_[byLabel[i]]);
+    } // for
+    labels_.swap(labels);
+    dictionary_.Rehash();
+    return newIds;
+  }
+
+  //========
+  // Motifs
+  //========
+  inline void Motifs::Read(NodeIds& ids) {
+    MotifReader reader(filename_);
+    binary_ = reader.Binary();
+    MotifType motifType;
+    Instance m;
+    m.order = 0;
+    auto add = [&] {
+      if ( (m.nodes[0] == m.nodes[1]) || (m.nodes[0] == m.nodes[2]) || (m.nodes[1] == m.nodes[2]) )
+        throw("The same node found more than once in a 3-motif at " + reader.Where() + " in " + filename_);
+      m.type = static_cast<std::uint8_t>(motifType);
+      instances_.push_back(m);
+    };
+
+    if ( binary_ ) {
+      // the file's own labels are interned once; records then only need their
+      //  ids translated
+      std::vector<std::uint32_t> fileToShared(reader.FileLabels());
+      for ( std::uint32_t n = 0; n < fileToShared.size(); ++n ) {
+        const LabelSpan label = reader.FileLabel(n);
+        fileToShared[n] = ids.Id(label.data, label.size);
+      } // for
+      std::uint32_t nodes[3];
+      while ( reader.Next(motifType, nodes) ) {
+        for ( int i = 0; i < 3; ++i )
+          m.nodes[i] = fileToShared[nodes[i]];
+        add();
+      } // while
+    } else {
+      LabelSpan nodes[3];
+      while ( reader.Next(motifType, nodes) ) {
+        for ( int i = 0; i < 3; ++i )
+          m.nodes[i] = ids.Id(nodes[i].data, nodes[i].size);
+        add();
+      } // while
+    }
+    instances_.shrink_to_fit();
+  }
+
+  inline void Motifs::Finish(const std::vector<std::uint32_t>& newIds) {
+    for ( auto& m : instances_ ) {
+      const std::uint32_t listed[3] = { newIds[m.nodes[0]], newIds[m.nodes[1]], newIds[m.nodes[2]] };
+      for ( std::uint8_t o = 0; o < 6; ++o ) {
+        if ( listed[Orders[o][0]] < listed[Orders[o][1]] && listed[Orders[o][1]] < listed[Orders[o][2]] ) {
+          // Orders[o] sorts, so its inverse takes sorted positions back to listed ones
+          for ( int i = 0; i < 3; ++i )
+            m.nodes[i] = listed[Orders[o][i]];
+          static const std::uint8_t inverse[6] = { 0, 1, 2, 4, 3, 5 };
+          m.order = inverse[o];
+          break;
+        }
+      } // for
+    } // for
+
+    index(true); // while rows are in file order, to say where a repeat is
+    std::sort(instances_.begin(), instances_.end(), [](const Instance& a, const Instance& b) {
+      return std::lexicographical_compare(a.nodes, a.nodes + 3, b.nodes, b.nodes + 3);
+    });
+    index(false);
+  }
+
+  inline void Motifs::index(bool check) {
+    std::size_t size = 16;
+    while ( size < 2 * instances_.size() )
+      size *= 2;
+    mask_ = size - 1;
+    slots_.assign(size, UINT32_MAX);
+
+    for ( std::size_t r = 0; r < instances_.size(); ++r ) {
+      std::size_t slot = hash(instances_[r]) & mask_;
+      while ( slots_[slot] != UINT32_MAX ) {
+        if ( check && instances_[slots_[slot]].SameNodes(instances_[r]) ) {
+          std::stringstream where; where << (binary_ ? "record: " : "line: ") << r + 1;
+          throw("Multiple rows have the same nodes. One is at " + where.str() + " in " + filename_);
+        }
+        slot = (slot + 1) & mask_;
+      } // while
+      slots_[slot] = static_cast<std::uint32_t>(r);
+    } // for
+  }
+
+  inline const Instance* Motifs::Find(const Instance& key) const {
+    std::size_t slot = hash(key) & mask_;
+    while ( slots_[slot] != UINT32_MAX ) {
+      if ( instances_[slots_[slot]].SameNodes(key) )
+        return &instances_[slots_[slot]];
+      slot = (slot + 1) & mask_;
+    } // while
+    return nullptr;
+  }
+
+  inline std::size_t Motifs::hash(const Instance& m) {
+    std::uint64_t h = (static_cast<std::uint64_t>(m.nodes[0]) << 32) | m.nodes[1];
+    h = (h ^ m.nodes[2]) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<std::size_t>(h ^ (h >> 29));
+  }
+
+  //=============
+  // map_motif()
+  //=============
+  // Count how one reference motif appears in the target, showing it in details
+  //  if given; trgType is NoMatch, and trg null, when its nodes form no target
+  //  motif.  Details is anything that takes strings and chars with <<.
+  template <typename Details>
+  void map_motif(MotifType refType, const std::string* const ref[3],
+                 MotifType trgType, const std::string* const trg[3],
+                 Counts& counts,
+                 Details* details) {
+
+    static const int hardcodeNetworkMotifSize = 3;
+    if ( details ) {
+      *details << *ref[0];
+      for ( int i = 1; i < hardcodeNetworkMotifSize; ++i )
+        *details << '\t' << *ref[i];
+    }
+
+    if ( trgType == NoMatch ) {
+      counts[refType][NoMatch]++;
+      if ( details )
+        *details << '\t' << get_name(refType) << "\tNo-Match\n";
+    } else if ( trgType != refType ) {
+      counts[refType][trgType]++;
+      if ( details )
+        *details << '\t' << get_name(refType) << '\t' << get_name(trgType) << '\n';
+    } else {
+      bool same = true;
+      switch (refType) {
+        case FFL: case MutualAnd3Chain: /* all order matters */
+        case MutualIn: case MutualOut:
+        case TreChain: case SemiClique:
+          for ( int i = 0; i < hardcodeNetworkMotifSize; ++i ) {
+            if ( *ref[i] != *trg[i] ) {
+              same = false;
+              break;
+            }
+          } // for
+          break;
+
+        /*
+        the next non-default case statements require detailed
+        knowledge of node order given by the find_3node_motifs program
+        turns out it's always a single node, and it's the first given
+        */
+        case Vout: case Vin: case MutualV:
+        case RegulatingMutual: case RegulatedMutual:
+          same = (*ref[0] == *trg[0]);
+          break;
+
+        default:
+          break;
+      };
+
+      if ( same ) {
+        counts[refType][refType]++;
+        if ( details )
+          *details << '\t' << get_name(refType) << '\t' << get_name(refType) << '\n';
+      } else {
+        counts[refType][modified_motif_type(refType)]++;
+        if ( details )
+          *details << '\t' << get_name(refType) << "\tdiff-" << get_name(refType) << '\n';
+      }
+    }
+  }
+
+  //===============
+  // init_counts()
+  //===============
+  inline void init_counts(Counts& counts) {
+    counts.clear();
+    for ( auto i = Vout; i < NumberOfBaseTypes; ) {
+      counts.insert(std::make_pair(i, std::vector<long>(static_cast<MotifType>(NumberOfTotalTypes), 0)));
+      i = static_cast<MotifType>(i+1);
+    } // for
+  }
+
+  //===================
+  // motif_evolution()
+  //===================
+  // How each motif of reference appears among the same nodes in target, as a
+  //  matrix of counts from reference types to target types, and a row for each
+  //  motif in details if given.  Both were read with ids.
+  template <typename Details>
+  void motif_evolution(const NodeIds& ids,
+                       const Motifs& target,
+                       const Motifs& reference,
+                       Counts& counts,
+                       Details* details) {
+
+    init_counts(counts);
+    const std::string* ref[3];
+    const std::string* trg[3];
+    for ( auto& r : reference.Instances() ) {
+      for ( int i = 0; i < 3; ++i )
+        ref[i] = &ids.Label(r.Listed(i));
+      const Instance* t = target.Find(r);
+      if ( t ) {
+        for ( int i = 0; i < 3; ++i )
+          trg[i] = &ids.Label(t->Listed(i));
+        map_motif(static_cast<MotifType>(r.type), ref, static_cast<MotifType>(t->type), trg, counts, details);
+      } else {
+        map_motif(static_cast<MotifType>(r.type), ref, NoMatch, nullptr, counts, details);
+      }
+    } // for
+  }
+
+  // motif_evolution() without details
+  inline void motif_evolution(const NodeIds& ids,
+                              const Motifs& target,
+                              const Motifs& reference,
+                              Counts& counts) {
+    motif_evolution(ids, target, reference, counts, static_cast<std::ostream*>(nullptr));
+  }
+
+  //=================
+  // matrix_header()
+  //=================
+  // The header row of a count summary; Out takes what Details does, and longs
+  template <typename Out>
+  void matrix_header(Out& out) {
+    out << "Motif-Type";
+    for ( auto i = Vout; i < NumberOfBaseTypes; i = static_cast<MotifType>(i+1) )
+      out << '\t' << get_name(i);
+    out << "\tNo-Match\tMatched-Variant\n";
+  }
+
+  //===============
+  // matrix_rows()
+  //===============
+  // The rows of a count summary, each starting with lead
+  template <typename Out>
+  void matrix_rows(Counts& counts, Out& out, const std::string& lead) {
+    MotifType diffType; // for cases when FFLs in both target/ref, but nodes rearranged
+    for ( auto i = Vout; i < NumberOfBaseTypes; i = static_cast<MotifType>(i+1) ) {
+      out << lead << get_name(i);
+      try {
+        diffType = modified_motif_type(i);
+      } catch(std::string& s) {
+        diffType = NoMatch;
+      }
+
+      for ( auto j = Vout; j < NumberOfBaseTypes; j = static_cast<MotifType>(j+1) )
+        out << '\t' << counts[i][j];
+      out << '\t' << counts[i][NoMatch];
+
+      if ( diffType != NoMatch )
+        out << '\t' << counts[i][diffType];
+      else
+        out << "\t0";
+      out << '\n';
+    } // for
+  }
+
+} // namespace changes
+} // namespace network_motifs
+
+#endif // NETWORK_MOTIFS_MOTIF_COMPARE_HPP
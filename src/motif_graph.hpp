@@ -0,0 +1,579 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#ifndef NETWORK_MOTIFS_MOTIF_GRAPH_HPP
+#define NETWORK_MOTIFS_MOTIF_GRAPH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+namespace network_motifs {
+
+  typedef std::uint32_t Node; // index into a Graph's node labels
+
+  // Read-only view of one node's sorted neighbors
+  struct Neighbors {
+    Neighbors(const Node* b, const Node* e) : b_(b), e_(e) {}
+    const Node* begin() const { return b_; }
+    const Node* end() const { return e_; }
+    std::size_t size() const { return e_ - b_; }
+    bool empty() const { return b_ == e_; }
+
+  private:
+    const Node* b_;
+    const Node* e_;
+  };
+
+  // A directed edge packed as (source << 32) | target, so packed edges sort by
+  //  (source, target)
+  typedef std::uint64_t Edge;
+
+  inline Edge pack(Node source, Node target) { return (Edge(source) << 32) | target; }
+  inline Node source(Edge e) { return static_cast<Node>(e >> 32); }
+  inline Node target(Edge e) { return static_cast<Node>(e); }
+
+  // Compressed sparse row adjacency: neighbors of node n are
+  //  nbrs_[offsets_[n]] ... nbrs_[offsets_[n+1]-1], in sorted order.  The arrays
+  //  are either built and owned here, or viewed in a mapped graph cache.
+  struct Csr {
+    Csr() : size_(0), offsetStore_(1, 0) { Attach(); }
+
+    // edges must be sorted by (source, target) with no duplicates
+    void Build(Node numNodes, const std::vector<Edge>& edges);
+    // use arrays that outlive this; offsets has numNodes+1 entries
+    void View(Node numNodes, const std::uint64_t* offsets, const Node* nbrs);
+
+    Node Size() const { return size_; }
+    Neighbors operator[](Node n) const {
+      return Neighbors(nbrs_ + offsets_[n], nbrs_ + offsets_[n+1]);
+    }
+    std::uint64_t NumberOfEdges() const { return offsets_[size_]; }
+    const std::uint64_t* Offsets() const { return offsets_; }
+    const Node* Targets() const { return nbrs_; }
+    // heap in use, not counting viewed arrays
+    std::size_t Bytes() const {
+      return offsetStore_.capacity() * sizeof(std::uint64_t) + nbrStore_.capacity() * sizeof(Node);
+    }
+
+  private:
+    Csr(const Csr&); // not copyable
+    Csr& operator=(const Csr&);
+    void Attach() { offsets_ = offsetStore_.data(); nbrs_ = nbrStore_.data(); }
+
+    Node size_;
+    const std::uint64_t* offsets_;
+    const Node* nbrs_;
+    std::vector<std::uint64_t> offsetStore_;
+    std::vector<Node> nbrStore_;
+  };
+
+  //========
+  // Labels
+  //========
+  // Node labels back to back in one block of text, owned or viewed like Csr
+  struct Labels {
+    Labels() : size_(0), offsetStore_(1, 0) { Attach(); }
+
+    void Build(const std::vector<std::string>& labels);
+    void View(Node numNodes, const std::uint64_t* offsets, const char* text);
+
+    Node Size() const { return size_; }
+    const char* Data(Node n) const { return text_ + offsets_[n]; }
+    std::size_t Length(Node n) const { return offsets_[n+1] - offsets_[n]; }
+    std::uint64_t TextBytes() const { return offsets_[size_]; }
+    const std::uint64_t* Offsets() const { return offsets_; }
+    const char* Text() const { return text_; }
+    // the id of label s, n bytes long, if it is one
+    bool Find(const char* s, std::size_t n, Node& id) const;
+    std::size_t Bytes() const {
+      return offsetStore_.capacity() * sizeof(std::uint64_t) + textStore_.capacity();
+    }
+
+  private:
+    Labels(const Labels&); // not copyable
+    Labels& operator=(const Labels&);
+    void Attach() { offsets_ = offsetStore_.data(); text_ = textStore_.data(); }
+
+    Node size_;
+    const std::uint64_t* offsets_;
+    const char* text_;
+    std::vector<std::uint64_t> offsetStore_;
+    std::vector<char> textStore_;
+  };
+
+  // How a neighbor is joined to a node: A->B only, B->A only, or both
+  enum EdgeClass { OutEdge, InEdge, MutualEdge };
+
+  typedef std::uint64_t Word;
+
+  inline bool test_bit(const Word* row, Node x) { return ((row[x >> 6] >> (x & 63)) & 1) != 0; }
+
+  //=========
+  // HubRows
+  //=========
+  // Dense bitset rows for nodes with many neighbors.  Bit x of To(h) is set when
+  //  h->x and bit x of From(h) when x->h, so each edge class of a hub, and
+  //  adjacency of any kind, is a word-wide expression over its two rows.
+  struct HubRows {
+    HubRows() : words_(0), hubs_(0) {}
+
+    // nodes with at least 'threshold' neighbors become hubs; 0 for none
+    void Build(const Csr& outs, const Csr& ins, const Csr& mutuals, Node threshold);
+
+    bool IsHub(Node n) const { return slot_[n] != NoSlot; }
+    const Word* To(Node h) const { return rows_.data() + 2 * slot_[h] * words_; }
+    const Word* From(Node h) const { return To(h) + words_; }
+
+    // words in a row
+    std::size_t Words() const { return words_; }
+    Node NumberOfHubs() const { return hubs_; }
+    std::size_t Bytes() const {
+      return slot_.capacity() * sizeof(Node) + rows_.capacity() * sizeof(Word);
+    }
+
+  private:
+    static const Node NoSlot = ~Node(0);
+    std::vector<Node> slot_; // row pair of each hub
+    std::vector<Word> rows_;
+    std::size_t words_;
+    Node hubs_;
+  };
+
+  // Word k of edge class c from hub rows to/from
+  inline Word class_word(const Word* to, const Word* from, std::size_t k, EdgeClass c) {
+    return (c == OutEdge) ? (to[k] & ~from[k]) : (c == InEdge) ? (from[k] & ~to[k]) : (to[k] & from[k]);
+  }
+
+  typedef Csr NetworkType;
+  typedef NetworkType BidirEdges;
+  typedef NetworkType UniEdges;
+
+  //=======
+  // Graph
+  //=======
+  // A directed graph as the four neighbor lists the motif searches work from,
+  //  with its node labels and hub rows.  Node ids are assigned in sorted label
+  //  order, so comparing two ids is the same as comparing their labels.
+  class Graph {
+  public:
+    Graph() {}
+
+    // Parse rows that look like A<tab>B, for an edge A->B; self-edges and
+    //  repeated rows are dropped
+    void Read(const MappedFile& file);
+
+    // A graph over numNodes nodes with unidirectional edges 'uni' and
+    //  bidirectional edges 'mutual' (each listed once), without labels; the
+    //  vectors are used up
+    void Build(Node numNodes, std::vector<Edge>& uni, std::vector<Edge>& mutual);
+
+    // Keep bitset rows for nodes with at least 'threshold' neighbors; 0 for none
+    void BuildHubs(Node threshold) { hubs_.Build(outs_, ins_, allBis_, threshold); }
+    // the larger of 64 and 1/32 of the nodes, where a row is no bigger than the lists
+    static Node DefaultHubDegree(Node numNodes) { return std::max<Node>(64, numNodes / 32); }
+
+    const BidirEdges& AllBidirectionalEdges() const { return allBis_; }
+    const BidirEdges& BidirectionalEdges() const { return bis_; }
+    const UniEdges& UnidirectionalInputEdges() const { return ins_; }
+    const UniEdges& UnidirectionalOutputEdges() const { return outs_; }
+    Neighbors Edges(Node n, EdgeClass c) const {
+      return (c == OutEdge) ? outs_[n] : (c == InEdge) ? ins_[n] : allBis_[n];
+    }
+    const HubRows& Hubs() const { return hubs_; }
+
+    Node NumberOfNodes() const { return outs_.Size(); }
+    const Labels& NodeLabels() const { return labels_; }
+
+  protected:
+    Labels labels_;
+    BidirEdges allBis_; // A<->B listed under both A and B
+    BidirEdges bis_; // A<->B listed under A only, where A < B
+    UniEdges outs_;
+    UniEdges ins_;
+    HubRows hubs_;
+
+  private:
+    Graph(const Graph&); // not copyable
+    Graph& operator=(const Graph&);
+  };
+
+  //============
+  // Dictionary
+  //============
+  // Open-addressing hash from label text to node id.  Labels are looked up in
+  //  place in the input; only new ones are copied, into the caller's labels.
+  class Dictionary {
+  public:
+    explicit Dictionary(std::vector<std::string>& labels) : labels_(labels), slots_(std::size_t(1) << 10, Empty()), log_(10), used_(0) {}
+
+    static std::uint32_t Hash(const char* s, std::size_t n);
+
+    // Lookups that miss the cache are overlapped by giving the hashes of a
+    //  batch of labels to PrefetchSlot(), then PrefetchLabel(), then Intern()
+    void PrefetchSlot(std::uint32_t hash) const {
+      __builtin_prefetch(&slots_[hash >> (32 - log_)]);
+    }
+    void PrefetchLabel(std::uint32_t hash) const {
+      const Slot& slot = slots_[hash >> (32 - log_)];
+      if ( slot.id != NoId && slot.tag == hash ) // the characters Intern() compares, not the string object
+        __builtin_prefetch(labels_[slot.id].data());
+    }
+
+    // id of the label s[0..n-1] with the given Hash(), taking the next id if it is new
+    Node Intern(const char* s, std::size_t n, std::uint32_t hash);
+    // index the caller's labels afresh, after they have been reordered
+    void Rehash();
+
+  private:
+    struct Slot {
+      std::uint32_t tag; // Hash() of the label: its home slot, and a quick compare
+      Node id; // NoId if empty
+    };
+    static const Node NoId = ~Node(0);
+    static Slot Empty() { Slot s = { 0, NoId }; return s; }
+
+    void grow();
+
+    std::vector<std::string>& labels_;
+    std::vector<Slot> slots_;
+    int log_; // slots_.size() == 1 << log_
+    std::size_t used_;
+  };
+
+  inline std::uint32_t Dictionary::Hash(const char* s, std::size_t n) {
+    std::uint64_t h = 0x9e3779b97f4a7c15ull ^ n;
+    std::uint64_t w;
+    for ( ; n >= 8; s += 8, n -= 8 ) {
+      std::memcpy(&w, s, 8);
+      h = (h ^ w) * 0xff51afd7ed558ccdull;
+      h ^= h >> 32;
+    } // for
+    w = 0;
+    std::memcpy(&w, s, n);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+    return static_cast<std::uint32_t>((h ^ (h >> 29)) >> 32);
+  }
+
+  inline Node Dictionary::Intern(const char* s, std::size_t n, std::uint32_t tag) {
+    if ( 2 * (used_ + 1) > slots_.size() )
+      grow();
+    const std::size_t mask = slots_.size() - 1;
+    for ( std::size_t i = tag >> (32 - log_); ; i = (i + 1) & mask ) {
+      Slot& slot = slots_[i];
+      if ( slot.id == NoId ) {
+        slot.tag = tag;
+        slot.id = static_cast<Node>(labels_.size());
+        labels_.push_back(std::string(s, n));
+        ++used_;
+        return slot.id;
+      }
+      const std::string& label = labels_[slot.id];
+      if ( slot.tag == tag && label.size() == n && std::memcmp(label.data(), s, n) == 0 )
+        return slot.id;
+    } // for
+  }
+
+  inline void Dictionary::grow() {
+    std::vector<Slot> old(2 * slots_.size(), Empty());
+    old.swap(slots_); // old now holds the current slots
+    ++log_;
+    const std::size_t mask = slots_.size() - 1;
+    for ( auto& slot : old ) {
+      if ( slot.id == NoId )
+        continue;
+      std::size_t i = slot.tag >> (32 - log_);
+      while ( slots_[i].id != NoId )
+        i = (i + 1) & mask;
+      slots_[i] = slot;
+    } // for
+  }
+
+  inline void Dictionary::Rehash() {
+    std::fill(slots_.begin(), slots_.end(), Empty());
+    while ( 2 * (labels_.size() + 1) > slots_.size() ) {
+      slots_.resize(2 * slots_.size(), Empty());
+      ++log_;
+    } // while
+    const std::size_t mask = slots_.size() - 1;
+    for ( Node id = 0; id < labels_.size(); ++id ) {
+      const std::uint32_t tag = Hash(labels_[id].data(), labels_[id].size());
+      std::size_t i = tag >> (32 - log_);
+      while ( slots_[i].id != NoId )
+        i = (i + 1) & mask;
+      slots_[i].tag = tag;
+      slots_[i].id = id;
+    } // for
+    used_ = labels_.size();
+  }
+
+  // Sort packed edges between numNodes nodes, 11 bits a pass, least significant
+  //  first, skipping the bits that no node id reaches
+  inline void radix_sort(std::vector<Edge>& edges, Node numNodes) {
+    int bits = 1;
+    while ( bits < 32 && (Node(1) << bits) < numNodes )
+      ++bits;
+    std::vector<Edge> other(edges.size());
+    const int shifts[] = { 0, 11, 22, 32, 43, 54 };
+    for ( int shift : shifts ) {
+      const int width = (shift < 32) ? std::min(11, 32 - shift) : 11;
+      if ( (shift < 32 && shift >= bits) || (shift >= 32 && shift - 32 >= bits) )
+        continue;
+      const std::size_t mask = (std::size_t(1) << width) - 1;
+      std::vector<std::size_t> count(mask + 2, 0);
+      for ( auto e : edges )
+        ++count[((e >> shift) & mask) + 1];
+      for ( std::size_t i = 1; i < count.size(); ++i )
+        count[i] += count[i - 1];
+      for ( auto e : edges )
+        other[count[(e >> shift) & mask]++] = e;
+      edges.swap(other);
+    } // for
+  }
+
+  inline void Csr::Build(Node numNodes, const std::vector<Edge>& edges) {
+    size_ = numNodes;
+    offsetStore_.assign(static_cast<std::size_t>(numNodes) + 1, 0);
+    nbrStore_.clear();
+    nbrStore_.reserve(edges.size());
+    for ( auto e : edges ) {
+      ++offsetStore_[source(e) + 1];
+      nbrStore_.push_back(target(e));
+    } // for
+    for ( Node n = 0; n < numNodes; ++n )
+      offsetStore_[n + 1] += offsetStore_[n];
+    Attach();
+  }
+
+  inline void Csr::View(Node numNodes, const std::uint64_t* offsets, const Node* nbrs) {
+    std::vector<std::uint64_t>().swap(offsetStore_);
+    std::vector<Node>().swap(nbrStore_);
+    size_ = numNodes;
+    offsets_ = offsets;
+    nbrs_ = nbrs;
+  }
+
+  inline void Labels::Build(const std::vector<std::string>& labels) {
+    size_ = static_cast<Node>(labels.size());
+    offsetStore_.assign(1, 0);
+    offsetStore_.reserve(labels.size() + 1);
+    textStore_.clear();
+    for ( auto& l : labels ) {
+      textStore_.insert(textStore_.end(), l.begin(), l.end());
+      offsetStore_.push_back(textStore_.size());
+    } // for
+    Attach();
+  }
+
+  inline void Labels::View(Node numNodes, const std::uint64_t* offsets, const char* text) {
+    std::vector<std::uint64_t>().swap(offsetStore_);
+    std::vector<char>().swap(textStore_);
+    size_ = numNodes;
+    offsets_ = offsets;
+    text_ = text;
+  }
+
+  inline bool Labels::Find(const char* s, std::size_t n, Node& id) const {
+    Node lo = 0, hi = size_; // labels are sorted
+    while ( lo < hi ) {
+      const Node mid = lo + (hi - lo) / 2;
+      int c = std::memcmp(Data(mid), s, std::min(Length(mid), n));
+      if ( c == 0 )
+        c = (Length(mid) < n) ? -1 : (Length(mid) > n);
+      if ( c == 0 ) {
+        id = mid;
+        return true;
+      }
+      if ( c < 0 )
+        lo = mid + 1;
+      else
+        hi = mid;
+    } // while
+    return false;
+  }
+
+  // uni holds A->B edges and mutual A<->B edges with A < B, in any order
+  inline void Graph::Build(Node numNodes, std::vector<Edge>& uni, std::vector<Edge>& mutual) {
+    std::vector<Edge> reversed(uni.size());
+    for ( std::size_t i = 0; i < uni.size(); ++i )
+      reversed[i] = pack(target(uni[i]), source(uni[i]));
+    radix_sort(uni, numNodes);
+    outs_.Build(numNodes, uni);
+    std::vector<Edge>().swap(uni);
+    radix_sort(reversed, numNodes);
+    ins_.Build(numNodes, reversed);
+
+    reversed.resize(2 * mutual.size());
+    for ( std::size_t i = 0; i < mutual.size(); ++i ) {
+      reversed[2*i] = mutual[i];
+      reversed[2*i+1] = pack(target(mutual[i]), source(mutual[i]));
+    } // for
+    radix_sort(mutual, numNodes);
+    bis_.Build(numNodes, mutual);
+    std::vector<Edge>().swap(mutual);
+    radix_sort(reversed, numNodes);
+    allBis_.Build(numNodes, reversed);
+  }
+
+  // Intern the labels of each row of file, giving ids in order of first
+  //  appearance, and call edge(a, b) for every row A->B other than a self-edge
+  template <typename EdgeFunction>
+  void parse_rows(const MappedFile& file, std::vector<std::string>& labels, EdgeFunction edge) {
+    Dictionary dictionary(labels);
+    const char* next = file.Data();
+    const char* const end = next + file.Size();
+    std::size_t rowid = 0;
+
+    // labels are split out and looked up a batch of rows at a time
+    const std::size_t Batch = 64;
+    const char* label[Batch];
+    std::size_t length[Batch];
+    std::uint32_t hash[Batch];
+    while ( next < end ) {
+      std::size_t k = 0;
+      for ( ; k < Batch && next < end; k += 2 ) {
+        ++rowid;
+        const char* eol = static_cast<const char*>(std::memchr(next, '\n', end - next));
+        if ( !eol )
+          eol = end;
+        const char* tab = static_cast<const char*>(std::memchr(next, '\t', eol - next));
+        if ( !tab ) {
+          std::stringstream conv; conv << rowid;
+          throw("No tab found at row: " + conv.str());
+        }
+        label[k] = next;
+        length[k] = tab - next;
+        label[k+1] = tab + 1;
+        length[k+1] = eol - tab - 1;
+        next = eol + 1;
+      } // for
+
+      for ( std::size_t i = 0; i < k; ++i ) {
+        hash[i] = Dictionary::Hash(label[i], length[i]);
+        dictionary.PrefetchSlot(hash[i]);
+      } // for
+      for ( std::size_t i = 0; i < k; ++i )
+        dictionary.PrefetchLabel(hash[i]);
+      for ( std::size_t i = 0; i < k; i += 2 ) {
+        const Node a = dictionary.Intern(label[i], length[i], hash[i]);
+        const Node b = dictionary.Intern(label[i+1], length[i+1], hash[i+1]);
+        if ( a != b ) // no self-edges in 3-node motifs
+          edge(a, b);
+      } // for
+    } // while
+  }
+
+  // Put labels in sorted order and return the new id of each old one, so that
+  //  ids sort the same way as their labels
+  inline std::vector<Node> sort_labels(std::vector<std::string>& labels) {
+    const Node numNodes = static_cast<Node>(labels.size());
+    std::vector<Node> rank(numNodes);
+
+    // most comparisons are settled by the first 8 bytes, without touching the strings
+    struct Key {
+      std::uint64_t prefix;
+      Node id;
+    };
+    std::vector<Key> order(numNodes);
+    for ( Node n = 0; n < numNodes; ++n ) {
+      unsigned char head[8] = { 0 };
+      std::memcpy(head, labels[n].data(), std::min<std::size_t>(8, labels[n].size()));
+      std::uint64_t prefix = 0;
+      for ( int i = 0; i < 8; ++i )
+        prefix = (prefix << 8) | head[i];
+      order[n].prefix = prefix;
+      order[n].id = n;
+    } // for
+    std::sort(order.begin(), order.end(), [&labels](const Key& a, const Key& b) {
+      return (a.prefix != b.prefix) ? (a.prefix < b.prefix) : (labels[a.id] < labels[b.id]);
+    });
+    std::vector<std::string> sortedLabels(numNodes);
+    for ( Node n = 0; n < numNodes; ++n ) {
+      rank[order[n].id] = n;
+      sortedLabels[n].swap(labels[order[n].id]);
+    } // for
+    labels.swap(sortedLabels);
+    return rank;
+  }
+
+  inline void Graph::Read(const MappedFile& file) {
+    // intern each label once; ids are given in order of first appearance for now
+    std::vector<std::string> labels;
+    std::vector<Edge> edges;
+    parse_rows(file, labels, [&edges](Node a, Node b) { edges.push_back(pack(a, b)); });
+
+    // renumber so that ids sort the same way as their labels
+    const Node numNodes = static_cast<Node>(labels.size());
+    {
+      std::vector<Node> rank = sort_labels(labels);
+      labels_.Build(labels);
+      std::vector<std::string>().swap(labels);
+      for ( auto& e : edges )
+        e = pack(rank[source(e)], rank[target(e)]);
+    }
+
+    // duplicate rows are not unique edges
+    radix_sort(edges, numNodes);
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    // A->B and B->A together make one bidirectional edge; everything else is
+    //  unidirectional.  Walk the edges alongside their sorted reversals.
+    std::vector<Edge> bis, outs;
+    {
+      std::vector<Edge> reversed(edges.size());
+      for ( std::size_t i = 0; i < edges.size(); ++i )
+        reversed[i] = pack(target(edges[i]), source(edges[i]));
+      radix_sort(reversed, numNodes);
+      std::size_t r = 0;
+      for ( auto e : edges ) {
+        while ( r < reversed.size() && reversed[r] < e )
+          ++r;
+        if ( r < reversed.size() && reversed[r] == e ) {
+          if ( source(e) < target(e) )
+            bis.push_back(e);
+        } else
+          outs.push_back(e);
+      } // for
+    }
+    std::vector<Edge>().swap(edges);
+    Build(numNodes, outs, bis);
+  }
+
+
+  inline void HubRows::Build(const Csr& outs, const Csr& ins, const Csr& mutuals, Node threshold) {
+    const Node numNodes = outs.Size();
+    words_ = (static_cast<std::size_t>(numNodes) + 63) / 64;
+    slot_.assign(numNodes, Node(NoSlot)); // a copy, so NoSlot needs no definition
+    hubs_ = 0;
+    for ( Node n = 0; n < numNodes; ++n ) {
+      if ( threshold > 0 && outs[n].size() + ins[n].size() + mutuals[n].size() >= threshold )
+        slot_[n] = hubs_++;
+    } // for
+
+    rows_.assign(2 * static_cast<std::size_t>(hubs_) * words_, 0);
+    for ( Node n = 0; n < numNodes; ++n ) {
+      if ( !IsHub(n) )
+        continue;
+      Word* to = rows_.data() + 2 * slot_[n] * words_;
+      Word* from = to + words_;
+      for ( auto x : outs[n] )
+        to[x >> 6] |= Word(1) << (x & 63);
+      for ( auto x : ins[n] )
+        from[x >> 6] |= Word(1) << (x & 63);
+      for ( auto x : mutuals[n] ) {
+        to[x >> 6] |= Word(1) << (x & 63);
+        from[x >> 6] |= Word(1) << (x & 63);
+      }
+    } // for
+  }
+
+} // namespace network_motifs
+
+#endif // NETWORK_MOTIFS_MOTIF_GRAPH_HPP
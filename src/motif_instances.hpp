@@ -0,0 +1,47 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#ifndef NETWORK_MOTIFS_MOTIF_INSTANCES_HPP
+#define NETWORK_MOTIFS_MOTIF_INSTANCES_HPP
+
+#include <cstdint>
+
+namespace network_motifs {
+
+  //=========================
+  // Binary motif instances
+  //=========================
+  // Written by find_3node_motifs --binary and read by motif3_network_changes.
+  //  A file is an InstanceHeader, then numNodes+1 offsets into a block of node
+  //  label text, then the text padded to 8 bytes, then InstanceRecords up to
+  //  the end of the file.  Numbers are in the byte order of the machine that
+  //  wrote the file.
+
+  struct InstanceHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t numNodes;
+    std::uint64_t labelBytes;
+  };
+
+  // One motif instance: a type code and node ids, in the order the text
+  //  output lists them
+  struct InstanceRecord {
+    std::uint32_t type;
+    std::uint32_t nodes[3];
+  };
+
+  const char InstanceMagic[8] = { '3', 'N', 'M', 'I', 'N', 'S', 'T', 'S' };
+  const std::uint32_t InstanceVersion = 1;
+
+  // Type codes index these names, which are the text output's without the colon
+  const int NumberOfInstanceTypes = 13;
+  char const* const InstanceTypeNames[NumberOfInstanceTypes] = {
+    "FFL", "3-Loop", "3-Chain", "V-out", "V-in", "Regulating-Mutual", "Regulated-Mutual",
+    "Clique", "Semi-Clique", "Mutual-And-3-Chain", "Mutual-V", "Mutual-Out", "Mutual-In"
+  };
+
+} // namespace network_motifs
+
+#endif // NETWORK_MOTIFS_MOTIF_INSTANCES_HPP
@@ -0,0 +1,1125 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#ifndef NETWORK_MOTIFS_MOTIF_SEARCH_HPP
+#define NETWORK_MOTIFS_MOTIF_SEARCH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#include "motif_graph.hpp"
+#include "motif_instances.hpp"
+#include "triads.hpp"
+
+namespace network_motifs {
+
+  // The 13 connected 3-node motifs, in the order find_3node_motifs reports them
+  enum MotifType {
+    FFL = 0, TreLoop, TreChain, Vout, Vin, RegulatingMutual, RegulatedMutual,
+    Clique, SemiClique, MutualAnd3Chain, MutualV, MutualOut, MutualIn,
+    NumberOfMotifTypes
+  };
+
+  typedef std::uint64_t Count;
+  typedef std::vector<Count> Census; // indexed by MotifType
+
+  // MotifType values are the type codes of binary output
+  char const* const* const MotifNames = InstanceTypeNames;
+  static_assert(NumberOfMotifTypes == NumberOfInstanceTypes, "motif types and codes differ");
+  static_assert(int(FFL) == int(triads::FFL) && int(MutualIn) == int(triads::MutualIn) &&
+                int(NumberOfMotifTypes) == int(triads::NotConnected), "motif types and triad types differ");
+
+  //=================
+  // Set op counters
+  //=================
+  // Set operations tally into the SetOpCounts of their thread, if it has one,
+  //  so that without them they cost one test of a thread-local pointer
+  enum SetOpKind { IntersectOp, DifferenceOp, MergeOp, NumberOfSetOpKinds };
+
+  struct SetOpCounts {
+    Count calls[NumberOfSetOpKinds];
+    Count elements[NumberOfSetOpKinds]; // in the lists given
+  };
+
+  // the counts of the calling thread, or null
+  inline SetOpCounts*& set_op_counts() {
+    static thread_local SetOpCounts* counts = nullptr;
+    return counts;
+  }
+
+  inline void count_set_op(SetOpKind kind, std::size_t elements) {
+    if ( SetOpCounts* c = set_op_counts() ) {
+      ++c->calls[kind];
+      c->elements[kind] += elements;
+    }
+  }
+
+  //=============
+  // Set kernels
+  //=============
+  // Intersection and difference of sorted neighbor lists.  Lists of similar
+  //  length are merged a block at a time with SIMD compares (AVX2 when the CPU
+  //  has it, else SSE2, else plain C++).  When one list is much longer than the
+  //  other, each member of the short one is found in the long one by galloping.
+  //  A null 'out' counts the result without writing it.
+
+  enum SetOperation { Intersect, Subtract };
+
+  // lists whose lengths differ by more than this factor use galloping search
+  const std::size_t GallopRatio = 32;
+
+  // First position in [first, last) not less than x, probing 1, 2, 4, ... steps out
+  inline const Node* gallop(const Node* first, const Node* last, Node x) {
+    if ( first == last || !(*first < x) )
+      return first;
+    const std::size_t n = last - first;
+    std::size_t lo = 0, hi = 1;
+    while ( hi < n && first[hi] < x ) {
+      lo = hi;
+      hi *= 2;
+    } // while
+    return std::lower_bound(first + lo + 1, first + std::min(hi + 1, n), x);
+  }
+
+  template <SetOperation Op>
+  inline void keep(bool inB, Node x, Node* out, std::size_t& n) {
+    if ( inB == (Op == Intersect) ) {
+      if ( out )
+        out[n] = x;
+      ++n;
+    }
+  }
+
+  // Finish a merge one element at a time.  The first few members of a may
+  //  already be known to be in b: bit k of 'found' is set for a[k].
+  template <SetOperation Op>
+  std::size_t merge_tail(const Node* a, const Node* ae, const Node* b, const Node* be,
+                         unsigned int found, Node* out, std::size_t n) {
+    for ( std::size_t k = 0; a != ae; ++a, ++k ) {
+      bool inB = k < 8 && ((found >> k) & 1);
+      if ( !inB ) {
+        while ( b != be && *b < *a )
+          ++b;
+        inB = (b != be && *b == *a);
+      }
+      keep<Op>(inB, *a, out, n);
+    } // for
+    return n;
+  }
+
+  template <SetOperation Op>
+  std::size_t merge_scalar(const Node* a, const Node* ae, const Node* b, const Node* be, Node* out) {
+    return merge_tail<Op>(a, ae, b, be, 0, out, 0);
+  }
+
+  // Keep members of a block of a by the bits of 'found'
+  template <SetOperation Op>
+  inline void keep_block(const Node* a, unsigned int found, unsigned int width, Node* out, std::size_t& n) {
+    unsigned int bits = (Op == Intersect) ? found : (~found & ((1u << width) - 1));
+    if ( !out ) {
+      n += __builtin_popcount(bits);
+      return;
+    }
+    for ( ; bits; bits &= bits - 1 )
+      out[n++] = a[__builtin_ctz(bits)];
+  }
+
+  template <SetOperation Op>
+  std::size_t gallop_merge(const Node* a, const Node* ae, const Node* b, const Node* be, Node* out) {
+    std::size_t n = 0;
+    if ( (ae - a) <= (be - b) ) { // look up each member of a in b
+      for ( ; a != ae; ++a ) {
+        b = gallop(b, be, *a);
+        keep<Op>(b != be && *b == *a, *a, out, n);
+      } // for
+      return n;
+    }
+
+    // look up each member of b in a
+    for ( ; b != be && a != ae; ++b ) {
+      const Node* at = gallop(a, ae, *b);
+      if ( Op == Subtract ) {
+        if ( out )
+          std::copy(a, at, out + n);
+        n += at - a;
+      }
+      a = at;
+      if ( a != ae && *a == *b ) {
+        if ( Op == Intersect )
+          keep<Op>(true, *a, out, n);
+        ++a;
+      }
+    } // for
+    if ( Op == Subtract ) {
+      if ( out )
+        std::copy(a, ae, out + n);
+      n += ae - a;
+    }
+    return n;
+  }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+  // Compare 4 members of a against 4 of b in every rotation, keeping a bit for
+  //  each member of a that was found.  Advance whichever block ends first.
+  template <SetOperation Op>
+  std::size_t merge_sse2(const Node* a, const Node* ae, const Node* b, const Node* be, Node* out) {
+    std::size_t n = 0;
+    unsigned int found = 0;
+    while ( ae - a >= 4 && be - b >= 4 ) {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+      const __m128i eq = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                     _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+        _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                     _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+      found |= _mm_movemask_ps(_mm_castsi128_ps(eq));
+      const Node amax = a[3], bmax = b[3];
+      if ( amax <= bmax ) {
+        keep_block<Op>(a, found, 4, out, n);
+        a += 4;
+        found = 0;
+      }
+      if ( bmax <= amax )
+        b += 4;
+    } // while
+    return merge_tail<Op>(a, ae, b, be, found, out, n);
+  }
+
+  // As merge_sse2(), 8 at a time
+  template <SetOperation Op>
+  __attribute__((target("avx2")))
+  std::size_t merge_avx2(const Node* a, const Node* ae, const Node* b, const Node* be, Node* out) {
+    std::size_t n = 0;
+    unsigned int found = 0;
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    while ( ae - a >= 8 && be - b >= 8 ) {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+      __m256i eq = _mm256_cmpeq_epi32(va, vb);
+      for ( int r = 1; r < 8; ++r ) {
+        vb = _mm256_permutevar8x32_epi32(vb, rotate);
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, vb));
+      } // for
+      found |= _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+      const Node amax = a[7], bmax = b[7];
+      if ( amax <= bmax ) {
+        keep_block<Op>(a, found, 8, out, n);
+        a += 8;
+        found = 0;
+      }
+      if ( bmax <= amax )
+        b += 8;
+    } // while
+    return merge_tail<Op>(a, ae, b, be, found, out, n);
+  }
+
+  inline bool cpu_has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }
+
+  const bool HaveAvx2 = cpu_has_avx2();
+#endif
+
+  template <SetOperation Op>
+  std::size_t set_operation(Neighbors a, Neighbors b, Node* out) {
+    const std::size_t na = a.size(), nb = b.size();
+    if ( na == 0 || nb == 0 ) {
+      if ( Op == Subtract && out )
+        std::copy(a.begin(), a.end(), out);
+      return (Op == Subtract) ? na : 0;
+    }
+    if ( na > GallopRatio * nb || nb > GallopRatio * na )
+      return gallop_merge<Op>(a.begin(), a.end(), b.begin(), b.end(), out);
+#if defined(__x86_64__) && defined(__GNUC__)
+    if ( HaveAvx2 )
+      return merge_avx2<Op>(a.begin(), a.end(), b.begin(), b.end(), out);
+    return merge_sse2<Op>(a.begin(), a.end(), b.begin(), b.end(), out);
+#else
+    return merge_scalar<Op>(a.begin(), a.end(), b.begin(), b.end(), out);
+#endif
+  }
+
+  // Members of a that are not in b, held in buf
+  inline Neighbors difference(Neighbors a, Neighbors b, std::vector<Node>& buf) {
+    count_set_op(DifferenceOp, a.size() + b.size());
+    if ( buf.size() < a.size() )
+      buf.resize(a.size());
+    return Neighbors(buf.data(), buf.data() + set_operation<Subtract>(a, b, buf.data()));
+  }
+
+  //===============
+  // Neighbor sets
+  //===============
+  // The neighbors of 'node' of one edge class, leaving out any below 'lowest'.
+  //  The operations below work on sorted lists, or on the rows of hubs when a
+  //  scan of the rows is shorter than the lists.
+
+  struct NodeSet {
+    Node node;
+    EdgeClass edges;
+    Node lowest;
+  };
+
+  inline NodeSet edges(Node n, EdgeClass c, Node lowest = 0) {
+    NodeSet s = { n, c, lowest };
+    return s;
+  }
+
+  inline Neighbors members(const Graph& graph, const NodeSet& s) {
+    Neighbors all = graph.Edges(s.node, s.edges);
+    if ( s.lowest == 0 )
+      return all;
+    return Neighbors(std::lower_bound(all.begin(), all.end(), s.lowest), all.end());
+  }
+
+  // Set bits of word(k), over the words holding ids of 'lowest' and up, as ids
+  template <typename WordAt>
+  std::size_t scan_words(WordAt word, std::size_t numWords, Node lowest, Node* out) {
+    std::size_t n = 0;
+    for ( std::size_t k = lowest >> 6; k < numWords; ++k ) {
+      Word w = word(k);
+      if ( k == (lowest >> 6) )
+        w &= ~Word(0) << (lowest & 63);
+      if ( !out )
+        n += __builtin_popcountll(w);
+      else {
+        for ( ; w; w &= w - 1 )
+          out[n++] = static_cast<Node>((k << 6) + __builtin_ctzll(w));
+      }
+    } // for
+    return n;
+  }
+
+  // Members of both a and b; a null out only counts them
+  inline std::size_t intersect(const Graph& graph, NodeSet a, NodeSet b, Node* out) {
+    const HubRows& hubs = graph.Hubs();
+    a.lowest = b.lowest = std::max(a.lowest, b.lowest);
+    Neighbors la = members(graph, a), lb = members(graph, b);
+    count_set_op(IntersectOp, la.size() + lb.size());
+    if ( lb.size() < la.size() ) {
+      std::swap(a, b);
+      std::swap(la, lb);
+    }
+    if ( la.empty() || !hubs.IsHub(b.node) )
+      return set_operation<Intersect>(la, lb, out);
+
+    const Word* to = hubs.To(b.node);
+    const Word* from = hubs.From(b.node);
+    if ( hubs.IsHub(a.node) && la.size() > hubs.Words() - (a.lowest >> 6) ) {
+      const Word* ato = hubs.To(a.node);
+      const Word* afrom = hubs.From(a.node);
+      return scan_words([&](std::size_t k) { return class_word(ato, afrom, k, a.edges) & class_word(to, from, k, b.edges); },
+                        hubs.Words(), a.lowest, out);
+    }
+
+    std::size_t n = 0; // look up the shorter list in b's rows
+    for ( auto x : la ) {
+      const Word bit = Word(1) << (x & 63);
+      if ( class_word(to, from, x >> 6, b.edges) & bit ) {
+        if ( out )
+          out[n] = x;
+        ++n;
+      }
+    } // for
+    return n;
+  }
+
+  // Members of both a and b, held in buf
+  inline Neighbors intersection(const Graph& graph, NodeSet a, NodeSet b, std::vector<Node>& buf) {
+    const std::size_t most = graph.Edges(a.node, a.edges).size();
+    if ( buf.size() < most )
+      buf.resize(most);
+    return Neighbors(buf.data(), buf.data() + intersect(graph, a, b, buf.data()));
+  }
+
+  inline Count intersection_size(const Graph& graph, NodeSet a, NodeSet b) {
+    return intersect(graph, a, b, nullptr);
+  }
+
+  // Two work lists reused across calls to not_adjacent()
+  struct Scratch {
+    std::vector<Node> x, y;
+  };
+
+  // Members of a that share no edge of any kind with node v
+  inline Neighbors not_adjacent(const Graph& graph, NodeSet a, Node v, Scratch& scratch) {
+    const HubRows& hubs = graph.Hubs();
+    Neighbors la = members(graph, a);
+    if ( !hubs.IsHub(v) ) {
+      Neighbors z = difference(la, graph.UnidirectionalOutputEdges()[v], scratch.x);
+      z = difference(z, graph.UnidirectionalInputEdges()[v], scratch.y);
+      return difference(z, graph.AllBidirectionalEdges()[v], scratch.x);
+    }
+
+    count_set_op(DifferenceOp, la.size());
+    if ( scratch.x.size() < la.size() )
+      scratch.x.resize(la.size());
+    Node* out = scratch.x.data();
+    const Word* vto = hubs.To(v);
+    const Word* vfrom = hubs.From(v);
+    std::size_t n = 0;
+    if ( hubs.IsHub(a.node) && la.size() > hubs.Words() - (a.lowest >> 6) ) {
+      const Word* to = hubs.To(a.node);
+      const Word* from = hubs.From(a.node);
+      n = scan_words([&](std::size_t k) { return class_word(to, from, k, a.edges) & ~(vto[k] | vfrom[k]); },
+                     hubs.Words(), a.lowest, out);
+    } else {
+      for ( auto x : la ) {
+        if ( !test_bit(vto, x) && !test_bit(vfrom, x) )
+          out[n++] = x;
+      } // for
+    }
+    return Neighbors(out, out + n);
+  }
+
+  //=======
+  // Sinks
+  //=======
+  // The searches below hand each instance they find to a sink: anything that
+  //  can be called as sink(type, a, b, c), with the nodes in the order
+  //  find_3node_motifs lists them.  The sink is a template parameter, so its
+  //  call is inlined into the search loop.  Given a CountOnly sink, a search
+  //  only counts, and the ones that close a triangle skip forming instances.
+  struct CountOnly {
+    void operator()(MotifType, Node, Node, Node) const {}
+  };
+
+  template <typename Sink>
+  struct visits_instances { static const bool value = true; };
+
+  template <>
+  struct visits_instances<CountOnly> { static const bool value = false; };
+
+  //=================
+  // Motif functions
+  //=================
+  // Each motif function below looks for instances anchored at source nodes
+  //  first ... last-1, hands them to sink and returns how many it found
+
+  template <typename Sink>
+  Count ffl(const Graph& graph, Node first, Node last, Sink& sink) {
+    const UniEdges& unidirOutEdges = graph.UnidirectionalOutputEdges();
+    std::vector<Node> buf;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors out_p = unidirOutEdges[p];
+      for ( auto v : out_p ) {
+        if ( !visits_instances<Sink>::value ) {
+          total += intersection_size(graph, edges(p, OutEdge), edges(v, OutEdge));
+          continue;
+        }
+        // Print node with two outgoing edges in FFL, then edge with 1 in and 1 out, then the sink
+        Neighbors z = intersection(graph, edges(p, OutEdge), edges(v, OutEdge), buf);
+        for ( auto zout : z )
+          sink(FFL, p, v, zout);
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count tre_loop(const Graph& graph, Node first, Node last, Sink& sink) {
+    const UniEdges& unidirOutEdges = graph.UnidirectionalOutputEdges();
+    const UniEdges& unidirInEdges = graph.UnidirectionalInputEdges();
+    std::vector<Node> buf;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      if ( unidirInEdges[p].empty() )
+        continue;
+      for ( auto v : unidirOutEdges[p] ) {
+        if ( v < p ) {
+          if ( !visits_instances<Sink>::value ) {
+            total += intersection_size(graph, edges(v, OutEdge, v + 1), edges(p, InEdge));
+            continue;
+          }
+          Neighbors z = intersection(graph, edges(v, OutEdge, v + 1), edges(p, InEdge), buf);
+          for ( auto zout : z )
+            sink(TreLoop, p, v, zout);
+          total += z.size();
+        }
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count tre_chain(const Graph& graph, Node first, Node last, Sink& sink) {
+    const UniEdges& unidirOutEdges = graph.UnidirectionalOutputEdges();
+    Scratch scratch;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      for ( auto v : unidirOutEdges[p] ) {
+        Neighbors y = not_adjacent(graph, edges(v, OutEdge), p, scratch);
+        if ( visits_instances<Sink>::value ) {
+          for ( auto yout : y )
+            sink(TreChain, p, v, yout);
+        }
+        total += y.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count v_out(const Graph& graph, Node first, Node last, Sink& sink) {
+    const UniEdges& unidirOutEdges = graph.UnidirectionalOutputEdges();
+    Scratch scratch;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors out_p = unidirOutEdges[p];
+      for ( auto v : out_p ) {
+        Neighbors z = not_adjacent(graph, edges(p, OutEdge, v + 1), v, scratch);
+        if ( visits_instances<Sink>::value ) {
+          for ( auto zout : z )
+            sink(Vout, p, v, zout);
+        }
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count v_in(const Graph& graph, Node first, Node last, Sink& sink) {
+    const UniEdges& unidirInEdges = graph.UnidirectionalInputEdges();
+    Scratch scratch;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors in_p = unidirInEdges[p];
+      for ( auto v : in_p ) {
+        Neighbors z = not_adjacent(graph, edges(p, InEdge, v + 1), v, scratch);
+        if ( visits_instances<Sink>::value ) {
+          for ( auto zout : z )
+            sink(Vin, p, v, zout);
+        }
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count regulating_mutual(const Graph& graph, Node first, Node last, Sink& sink) {
+    // print node associated with 2 unidir edges, then remaining edges in alphabetical order
+    const BidirEdges& bidirEdges = graph.BidirectionalEdges();
+    const UniEdges& unidirOutEdges = graph.UnidirectionalOutputEdges();
+    std::vector<Node> buf;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors out_p = unidirOutEdges[p];
+      if ( out_p.empty() )
+        continue;
+      for ( auto v : bidirEdges[p] ) {
+        if ( !visits_instances<Sink>::value ) {
+          total += intersection_size(graph, edges(p, OutEdge), edges(v, OutEdge));
+          continue;
+        }
+        Neighbors z = intersection(graph, edges(p, OutEdge), edges(v, OutEdge), buf);
+        for ( auto zout : z )
+          sink(RegulatingMutual, zout, p, v);
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count regulated_mutual(const Graph& graph, Node first, Node last, Sink& sink) {
+    // Print node associated with 2 unidir edges, then remaining edges in alphabetical order
+    const BidirEdges& bidirEdges = graph.BidirectionalEdges();
+    const UniEdges& unidirInEdges = graph.UnidirectionalInputEdges();
+    std::vector<Node> buf;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors in_p = unidirInEdges[p];
+      if ( in_p.empty() )
+        continue;
+      for ( auto v : bidirEdges[p] ) {
+        if ( !visits_instances<Sink>::value ) {
+          total += intersection_size(graph, edges(p, InEdge), edges(v, InEdge));
+          continue;
+        }
+        Neighbors z = intersection(graph, edges(p, InEdge), edges(v, InEdge), buf);
+        for ( auto zout : z )
+          sink(RegulatedMutual, zout, p, v);
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count clique(const Graph& graph, Node first, Node last, Sink& sink) {
+    // remember bidirEdges[A] has B only if A < B and A<->B
+    const BidirEdges& bidirEdges = graph.BidirectionalEdges();
+    std::vector<Node> buf;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors bis_p = bidirEdges[p];
+      for ( auto v : bis_p ) {
+        // v > p, so the third node is a mutual neighbor of both above v
+        if ( !visits_instances<Sink>::value ) {
+          total += intersection_size(graph, edges(p, MutualEdge, v + 1), edges(v, MutualEdge, v + 1));
+          continue;
+        }
+        Neighbors z = intersection(graph, edges(p, MutualEdge, v + 1), edges(v, MutualEdge, v + 1), buf);
+        for ( auto zout : z )
+          sink(Clique, p, v, zout);
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count semi_clique(const Graph& graph, Node first, Node last, Sink& sink) {
+    const BidirEdges& allBidirEdges = graph.AllBidirectionalEdges();
+    std::vector<Node> buf;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors all_p = allBidirEdges[p];
+      for ( auto v : all_p ) {
+        if ( !visits_instances<Sink>::value ) {
+          total += intersection_size(graph, edges(p, MutualEdge), edges(v, OutEdge));
+          continue;
+        }
+        Neighbors z = intersection(graph, edges(p, MutualEdge), edges(v, OutEdge), buf);
+        for ( auto zout : z )
+          sink(SemiClique, p, v, zout);
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count mutual_tre_chain(const Graph& graph, Node first, Node last, Sink& sink) {
+    const BidirEdges& allBidirEdges = graph.AllBidirectionalEdges();
+    const UniEdges& unidirOutEdges = graph.UnidirectionalOutputEdges();
+    std::vector<Node> buf;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors out_p = unidirOutEdges[p];
+      if ( out_p.empty() )
+        continue;
+      for ( auto v : allBidirEdges[p] ) {
+        if ( !visits_instances<Sink>::value ) {
+          total += intersection_size(graph, edges(p, OutEdge), edges(v, InEdge));
+          continue;
+        }
+        Neighbors z = intersection(graph, edges(p, OutEdge), edges(v, InEdge), buf);
+        for ( auto zout : z )
+          sink(MutualAnd3Chain, p, zout, v);
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count mutual_v(const Graph& graph, Node first, Node last, Sink& sink) {
+    const BidirEdges& allBidirEdges = graph.AllBidirectionalEdges();
+    Scratch scratch;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors all_p = allBidirEdges[p];
+      for ( auto v : all_p ) {
+        Neighbors z = not_adjacent(graph, edges(p, MutualEdge, v + 1), v, scratch);
+        if ( visits_instances<Sink>::value ) {
+          for ( auto zout : z )
+            sink(MutualV, p, v, zout);
+        }
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count mutual_out(const Graph& graph, Node first, Node last, Sink& sink) {
+    const BidirEdges& allBidirEdges = graph.AllBidirectionalEdges();
+    const UniEdges& unidirOutEdges = graph.UnidirectionalOutputEdges();
+    Scratch scratch;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors out_p = unidirOutEdges[p];
+      if ( out_p.empty() )
+        continue;
+      for ( auto v : allBidirEdges[p] ) {
+        Neighbors z = not_adjacent(graph, edges(p, OutEdge), v, scratch);
+        if ( visits_instances<Sink>::value ) {
+          for ( auto zout : z )
+            sink(MutualOut, p, v, zout);
+        }
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  template <typename Sink>
+  Count mutual_in(const Graph& graph, Node first, Node last, Sink& sink) {
+    const BidirEdges& allBidirEdges = graph.AllBidirectionalEdges();
+    const UniEdges& unidirInEdges = graph.UnidirectionalInputEdges();
+    Scratch scratch;
+    Count total = 0;
+    for ( Node p = first; p < last; ++p ) {
+      Neighbors in_p = unidirInEdges[p];
+      if ( in_p.empty() )
+        continue;
+      for ( auto v : allBidirEdges[p] ) {
+        Neighbors z = not_adjacent(graph, edges(p, InEdge), v, scratch);
+        if ( visits_instances<Sink>::value ) {
+          for ( auto zout : z )
+            sink(MutualIn, p, v, zout);
+        }
+        total += z.size();
+      } // for
+    } // for
+    return total;
+  }
+
+  // The motif function for 'type'
+  template <typename Sink>
+  Count find_instances(const Graph& graph, MotifType type, Node first, Node last, Sink& sink) {
+    switch (type) {
+      case FFL:
+        return ffl(graph, first, last, sink);
+      case TreLoop:
+        return tre_loop(graph, first, last, sink);
+      case TreChain:
+        return tre_chain(graph, first, last, sink);
+      case Vout:
+        return v_out(graph, first, last, sink);
+      case Vin:
+        return v_in(graph, first, last, sink);
+      case RegulatingMutual:
+        return regulating_mutual(graph, first, last, sink);
+      case RegulatedMutual:
+        return regulated_mutual(graph, first, last, sink);
+      case Clique:
+        return clique(graph, first, last, sink);
+      case SemiClique:
+        return semi_clique(graph, first, last, sink);
+      case MutualAnd3Chain:
+        return mutual_tre_chain(graph, first, last, sink);
+      case MutualV:
+        return mutual_v(graph, first, last, sink);
+      case MutualOut:
+        return mutual_out(graph, first, last, sink);
+      case MutualIn:
+        return mutual_in(graph, first, last, sink);
+      default:
+        return 0;
+    };
+  }
+
+  //===============
+  // single_pass()
+  //===============
+  // Undirected view of the graph used by single_pass(): every neighbor of a
+  //  node, sorted, along with how the two are connected
+  struct Adjacency {
+    enum { Out = 1, In = 2, Mutual = Out | In };
+
+    explicit Adjacency(const Graph& graph);
+
+    Neighbors operator[](Node n) const {
+      return Neighbors(nbrs_.data() + offsets_[n], nbrs_.data() + offsets_[n+1]);
+    }
+    // relation of n to each of operator[](n)
+    const std::uint8_t* Kinds(Node n) const { return kinds_.data() + offsets_[n]; }
+
+  private:
+    std::vector<std::size_t> offsets_;
+    std::vector<Node> nbrs_;
+    std::vector<std::uint8_t> kinds_;
+  };
+
+  // Append the neighbors of n to nbrs, sorted, and how n is joined to each to kinds
+  inline void append_neighbors(const Graph& graph, Node n, std::vector<Node>& nbrs, std::vector<std::uint8_t>& kinds) {
+    const Neighbors lists[3] = { graph.UnidirectionalOutputEdges()[n],
+                                 graph.UnidirectionalInputEdges()[n],
+                                 graph.AllBidirectionalEdges()[n] };
+    const std::uint8_t relations[3] = { Adjacency::Out, Adjacency::In, Adjacency::Mutual };
+    const Node* at[3] = { lists[0].begin(), lists[1].begin(), lists[2].begin() };
+    while ( true ) { // 3-way merge; a neighbor is in exactly one of the lists
+      int next = -1;
+      for ( int i = 0; i < 3; ++i ) {
+        if ( at[i] != lists[i].end() && (next < 0 || *at[i] < *at[next]) )
+          next = i;
+      } // for
+      if ( next < 0 )
+        break;
+      nbrs.push_back(*at[next]++);
+      kinds.push_back(relations[next]);
+    } // while
+  }
+
+  inline Adjacency::Adjacency(const Graph& graph) : offsets_(1, 0) {
+    for ( Node n = 0; n < graph.NumberOfNodes(); ++n ) {
+      append_neighbors(graph, n, nbrs_, kinds_);
+      offsets_.push_back(nbrs_.size());
+    } // for
+  }
+
+  // relation of y to x given that of x to y
+  inline unsigned int flip(unsigned int r) { return ((r & 1) << 1) | (r >> 1); }
+
+  // The triple x, y, z, joined by relations rxy, rxz and ryz (0 for none),
+  //  counted in census and handed to sink with its nodes in listed order
+  template <typename Sink>
+  inline void census_triple(Node x, Node y, Node z, unsigned int rxy, unsigned int rxz, unsigned int ryz,
+                            Census& census, Sink& sink) {
+    // into id order, as the triad table expects; a pair that swaps flips its relation
+    if ( y < x ) { std::swap(x, y); rxy = flip(rxy); std::swap(rxz, ryz); }
+    if ( z < y ) { std::swap(y, z); ryz = flip(ryz); std::swap(rxy, rxz); }
+    if ( y < x ) { std::swap(x, y); rxy = flip(rxy); std::swap(rxz, ryz); }
+    const triads::Triad& t = triads::triadTable.entries[triads::triad_code(rxy, rxz, ryz)];
+    ++census[t.type];
+    if ( visits_instances<Sink>::value ) {
+      const Node n[3] = { x, y, z };
+      sink(static_cast<MotifType>(t.type), n[t.order[0]], n[t.order[1]], n[t.order[2]]);
+    }
+  }
+
+  // Visit every connected triple once, anchored at its smallest node u of some
+  //  connected pair u < v, and classify it by table lookup: visit(triad, n) is
+  //  called with the triple's nodes n in id order
+  template <typename Visit>
+  void visit_triads(const Adjacency& adjacency, Node first, Node last, Visit visit) {
+    for ( Node u = first; u < last; ++u ) {
+      const Neighbors nu = adjacency[u];
+      const std::uint8_t* ku = adjacency.Kinds(u);
+      for ( auto vi = std::upper_bound(nu.begin(), nu.end(), u); vi != nu.end(); ++vi ) {
+        const Node v = *vi;
+        const unsigned int ruv = ku[vi - nu.begin()];
+        const Neighbors nv = adjacency[v];
+        const std::uint8_t* kv = adjacency.Kinds(v);
+        const Node* a = nu.begin();
+        const Node* b = nv.begin();
+        count_set_op(MergeOp, nu.size() + nv.size());
+        while ( a != nu.end() || b != nv.end() ) { // merge the neighbors of u and v
+          Node w;
+          unsigned int ruw = 0, rvw = 0;
+          if ( b == nv.end() || (a != nu.end() && *a < *b) ) {
+            w = *a; ruw = ku[a++ - nu.begin()];
+          } else if ( a == nu.end() || *b < *a ) {
+            w = *b; rvw = kv[b++ - nv.begin()];
+          } else {
+            w = *a; ruw = ku[a++ - nu.begin()]; rvw = kv[b++ - nv.begin()];
+          }
+          if ( w == u || w == v )
+            continue;
+          if ( !(v < w || (u < w && ruw == 0)) ) // found from another pair
+            continue;
+
+          // put the triple in id order: u < v always
+          Node n[3] = { u, v, w };
+          unsigned int r01 = ruv, r02 = ruw, r12 = rvw;
+          if ( w < u ) { // w u v
+            n[0] = w; n[1] = u; n[2] = v;
+            r01 = flip(ruw); r02 = flip(rvw); r12 = ruv;
+          } else if ( w < v ) { // u w v
+            n[1] = w; n[2] = v;
+            r01 = ruw; r02 = ruv; r12 = flip(rvw);
+          }
+          visit(triads::triadTable.entries[triads::triad_code(r01, r02, r12)], n);
+        } // while
+      } // for
+    } // for
+  }
+
+  // Every motif anchored at first ... last-1 in one sweep: each is counted in
+  //  census and handed to sink
+  template <typename Sink>
+  void single_pass(const Adjacency& adjacency, Node first, Node last, Census& census, Sink& sink) {
+    visit_triads(adjacency, first, last, [&](const triads::Triad& t, const Node n[3]) {
+      ++census[t.type];
+      if ( visits_instances<Sink>::value )
+        sink(static_cast<MotifType>(t.type), n[t.order[0]], n[t.order[1]], n[t.order[2]]);
+    });
+  }
+
+  //=========
+  // Triples
+  //=========
+  // How x is joined to y, as in Adjacency, or 0 when they are not joined
+  inline unsigned int relation(const Graph& graph, Node x, Node y) {
+    auto has = [y](Neighbors nbrs) { return std::binary_search(nbrs.begin(), nbrs.end(), y); };
+    if ( has(graph.UnidirectionalOutputEdges()[x]) )
+      return Adjacency::Out;
+    if ( has(graph.UnidirectionalInputEdges()[x]) )
+      return Adjacency::In;
+    return has(graph.AllBidirectionalEdges()[x]) ? Adjacency::Mutual : 0;
+  }
+
+  // Type of the distinct nodes x, y and z in graph, or triads::NotConnected;
+  //  listed gets them in the order a motif of that type is listed
+  inline int classify_triple(const Graph& graph, Node x, Node y, Node z, Node listed[3]) {
+    Node n[3] = { x, y, z };
+    std::sort(n, n + 3);
+    const unsigned int r01 = relation(graph, n[0], n[1]);
+    const unsigned int r02 = relation(graph, n[0], n[2]);
+    const unsigned int r12 = relation(graph, n[1], n[2]);
+    const triads::Triad& t = triads::triadTable.entries[triads::triad_code(r01, r02, r12)];
+    for ( int i = 0; i < 3; ++i )
+      listed[i] = n[t.order[i]];
+    return t.type;
+  }
+
+  //=================
+  // Degree ordering
+  //=================
+  // The graph with nodes relabeled by rank, their place in order of degree
+  //  (ties by id), so that hubs rank highest.  Each connected triple is found
+  //  once, from its lowest-ranked node a.  The neighbors a ranks below have at
+  //  least its degree, so there are at most about sqrt(2m) of them among m
+  //  edges, and finding every triangle takes O(m sqrt(m)).  An open triple
+  //  costs a step of its own, however its center is ranked.
+  class RankedAdjacency {
+  public:
+    explicit RankedAdjacency(const Graph& graph);
+
+    Node Size() const { return static_cast<Node>(ids_.size()); }
+    // the node of rank r, and the rank of node n
+    Node Id(Node r) const { return ids_[r]; }
+    Node Rank(Node n) const { return ranks_[n]; }
+
+    // the ranks of the neighbors of rank r, in increasing order
+    Neighbors operator[](Node r) const {
+      return Neighbors(nbrs_.data() + offsets_[r], nbrs_.data() + offsets_[r+1]);
+    }
+    // those ranked above r
+    Neighbors Up(Node r) const {
+      const Neighbors all = (*this)[r];
+      return Neighbors(std::upper_bound(all.begin(), all.end(), r), all.end());
+    }
+    // relation of rank r to each of operator[](r), as in Adjacency
+    const std::uint8_t* Kinds(Node r) const { return kinds_.data() + offsets_[r]; }
+
+    // relative work of anchoring a search at rank r
+    Count Work(Node r) const {
+      const Neighbors up = Up(r);
+      Count w = 1;
+      for ( auto b : up )
+        w += up.size() + (*this)[b].size();
+      return w;
+    }
+
+  private:
+    std::vector<Node> ids_, ranks_;
+    std::vector<std::size_t> offsets_;
+    std::vector<Node> nbrs_;
+    std::vector<std::uint8_t> kinds_;
+  };
+
+  inline RankedAdjacency::RankedAdjacency(const Graph& graph)
+      : ids_(graph.NumberOfNodes()), ranks_(graph.NumberOfNodes()), offsets_(graph.NumberOfNodes() + std::size_t(1), 0) {
+    const Node numNodes = graph.NumberOfNodes();
+    const UniEdges& outs = graph.UnidirectionalOutputEdges();
+    const UniEdges& ins = graph.UnidirectionalInputEdges();
+    const BidirEdges& mutuals = graph.AllBidirectionalEdges();
+
+    // counting sort by degree, stable so that ties stay in id order
+    std::vector<Node> degree(numNodes);
+    Node most = 0;
+    for ( Node n = 0; n < numNodes; ++n ) {
+      degree[n] = static_cast<Node>(outs[n].size() + ins[n].size() + mutuals[n].size());
+      most = std::max(most, degree[n]);
+    } // for
+    std::vector<std::size_t> start(most + std::size_t(2), 0);
+    for ( Node n = 0; n < numNodes; ++n )
+      ++start[degree[n] + 1];
+    for ( std::size_t d = 1; d < start.size(); ++d )
+      start[d] += start[d-1];
+    for ( Node n = 0; n < numNodes; ++n )
+      ids_[start[degree[n]]++] = n;
+    for ( Node r = 0; r < numNodes; ++r ) {
+      ranks_[ids_[r]] = r;
+      offsets_[r+1] = offsets_[r] + degree[ids_[r]];
+    } // for
+
+    // hand each rank in turn to its neighbors, whose lists so come out in order
+    nbrs_.resize(offsets_[numNodes]);
+    kinds_.resize(offsets_[numNodes]);
+    std::vector<std::size_t> at(offsets_.begin(), offsets_.end() - 1);
+    const std::uint8_t kinds[3] = { Adjacency::Out, Adjacency::In, Adjacency::Mutual };
+    for ( Node r = 0; r < numNodes; ++r ) {
+      const Node n = ids_[r];
+      const Neighbors lists[3] = { outs[n], ins[n], mutuals[n] };
+      for ( int i = 0; i < 3; ++i ) {
+        for ( auto x : lists[i] ) {
+          const std::size_t k = at[ranks_[x]]++;
+          nbrs_[k] = r;
+          kinds_[k] = static_cast<std::uint8_t>(flip(kinds[i]));
+        } // for
+      } // for
+    } // for
+  }
+
+  // Every connected triple whose lowest rank is one of first ... last-1, or
+  //  only the triangles among them: each is counted in census and handed to
+  //  sink, which gets the same instances as from the motif functions
+  template <typename Sink>
+  void ranked_pass(const RankedAdjacency& ranked, Node first, Node last, bool trianglesOnly,
+                   Census& census, Sink& sink) {
+    for ( Node a = first; a < last; ++a ) {
+      const Neighbors na = ranked[a];
+      const std::uint8_t* ka = ranked.Kinds(a);
+      const Neighbors up = ranked.Up(a);
+      for ( const Node* bi = up.begin(); bi != up.end(); ++bi ) {
+        const Node b = *bi;
+        const unsigned int rab = ka[bi - na.begin()];
+        const Neighbors nb = ranked[b];
+        const std::uint8_t* kb = ranked.Kinds(b);
+
+        // a's neighbors ranked above b: a triangle when b is joined to it too,
+        //  else an open triple around a
+        const Neighbors upb = ranked.Up(b);
+        const Node* y = upb.begin();
+        count_set_op(MergeOp, (up.end() - bi - 1) + upb.size());
+        for ( const Node* x = bi + 1; x != up.end(); ++x ) {
+          while ( y != upb.end() && *y < *x )
+            ++y;
+          if ( y != upb.end() && *y == *x )
+            census_triple(ranked.Id(a), ranked.Id(b), ranked.Id(*x), rab, ka[x - na.begin()], kb[y - nb.begin()], census, sink);
+          else if ( !trianglesOnly )
+            census_triple(ranked.Id(a), ranked.Id(b), ranked.Id(*x), rab, ka[x - na.begin()], 0, census, sink);
+        } // for
+        if ( trianglesOnly )
+          continue;
+
+        // b's neighbors ranked above a that a is not joined to: an open triple
+        //  around b
+        const Node* w = up.begin();
+        const Node* z = std::upper_bound(nb.begin(), nb.end(), a);
+        count_set_op(DifferenceOp, (nb.end() - z) + up.size());
+        for ( ; z != nb.end(); ++z ) {
+          while ( w != up.end() && *w < *z )
+            ++w;
+          if ( w == up.end() || *w != *z )
+            census_triple(ranked.Id(a), ranked.Id(b), ranked.Id(*z), rab, 0, kb[z - nb.begin()], census, sink);
+        } // for
+      } // for
+    } // for
+  }
+
+  //===============
+  // Seeded search
+  //===============
+  // Only the triples holding at least one of a set of seed nodes, or only
+  //  those whose nodes are all seeds.  Each is found once, from its lowest seed
+  //  s, by merging the neighbors of s with those of each neighbor in turn, so
+  //  the work grows with the seeds' two-hop neighborhoods and not with the
+  //  graph, and nothing is built beyond the graph's own neighbor lists.
+
+  // Every such triple found from seeds[first] ... seeds[last-1], where seeds
+  //  holds node ids in increasing order: each is counted in census and handed
+  //  to sink, which gets the same instances as from the motif functions
+  template <typename Sink>
+  void seeded_pass(const Graph& graph, const std::vector<Node>& seeds, std::size_t first, std::size_t last,
+                   bool allSeeds, Census& census, Sink& sink) {
+    std::vector<Node> ns, nx;
+    std::vector<std::uint8_t> ks, kx;
+    for ( std::size_t i = first; i < last; ++i ) {
+      const Node s = seeds[i];
+      const auto at = seeds.begin() + i;
+      // x keeps the triple from being found from s: an earlier seed, or a
+      //  node that is not a later seed when all three must be seeds
+      auto skip = [&](Node x) {
+        return allSeeds ? !std::binary_search(at + 1, seeds.end(), x)
+                        : (x < s && std::binary_search(seeds.begin(), at, x));
+      };
+
+      ns.clear();
+      ks.clear();
+      append_neighbors(graph, s, ns, ks);
+      for ( std::size_t j = 0; j < ns.size(); ++j ) {
+        const Node x = ns[j];
+        if ( skip(x) )
+          continue;
+        nx.clear();
+        kx.clear();
+        append_neighbors(graph, x, nx, kx);
+
+        // a neighbor y of s after x makes a triangle when x is joined to it
+        //  too, else an open triple around s; a neighbor of x alone makes an
+        //  open triple around x
+        std::size_t a = 0, b = 0;
+        count_set_op(MergeOp, ns.size() + nx.size());
+        while ( a < ns.size() || b < nx.size() ) {
+          if ( b == nx.size() || (a < ns.size() && ns[a] < nx[b]) ) {
+            if ( a > j && !skip(ns[a]) )
+              census_triple(s, x, ns[a], ks[j], ks[a], 0, census, sink);
+            ++a;
+          } else if ( a == ns.size() || nx[b] < ns[a] ) {
+            if ( nx[b] != s && !skip(nx[b]) )
+              census_triple(s, x, nx[b], ks[j], 0, kx[b], census, sink);
+            ++b;
+          } else {
+            if ( a > j && !skip(ns[a]) )
+              census_triple(s, x, ns[a], ks[j], ks[a], kx[b], census, sink);
+            ++a;
+            ++b;
+          }
+        } // while
+      } // for
+    } // for
+  }
+
+  //========
+  // Census
+  //========
+  // Only motifs that close a triangle need to be searched for to count them
+  //  all.  Every pair of edges that meet at a node is an open motif unless its
+  //  two far ends are adjacent, and each triangle motif accounts for a fixed
+  //  number of such pairs.
+  const MotifType ClosedMotifs[] = { FFL, TreLoop, RegulatingMutual, RegulatedMutual, Clique, SemiClique, MutualAnd3Chain };
+
+  // Fill in the open types of a census that has counts of the ClosedMotifs
+  inline void count_open_motifs(const Graph& graph, Census& census) {
+    Count outPairs = 0, inPairs = 0, inOut = 0, mutualPairs = 0, mutualOut = 0, mutualIn = 0;
+    for ( Node n = 0; n < graph.NumberOfNodes(); ++n ) {
+      const Count o = graph.UnidirectionalOutputEdges()[n].size();
+      const Count i = graph.UnidirectionalInputEdges()[n].size();
+      const Count m = graph.AllBidirectionalEdges()[n].size();
+      outPairs += o * (o - 1) / 2;
+      inPairs += i * (i - 1) / 2;
+      inOut += i * o;
+      mutualPairs += m * (m - 1) / 2;
+      mutualOut += m * o;
+      mutualIn += m * i;
+    } // for
+
+    census[TreChain] = inOut - census[FFL] - 3 * census[TreLoop] - census[MutualAnd3Chain];
+    census[Vout] = outPairs - census[FFL] - census[RegulatedMutual];
+    census[Vin] = inPairs - census[FFL] - census[RegulatingMutual];
+    census[MutualV] = mutualPairs - 3 * census[Clique] - census[SemiClique];
+    census[MutualOut] = mutualOut - census[MutualAnd3Chain] - 2 * census[RegulatingMutual] - census[SemiClique];
+    census[MutualIn] = mutualIn - census[MutualAnd3Chain] - 2 * census[RegulatedMutual] - census[SemiClique];
+  }
+
+  // How many instances of each motif type the graph has, on the calling thread
+  inline Census motif_counts(const Graph& graph) {
+    Census census(NumberOfMotifTypes, 0);
+    CountOnly count;
+    for ( auto m : ClosedMotifs )
+      census[m] = find_instances(graph, m, 0, graph.NumberOfNodes(), count);
+    count_open_motifs(graph, census);
+    return census;
+  }
+
+} // namespace network_motifs
+
+#endif // NETWORK_MOTIFS_MOTIF_SEARCH_HPP
@@ -0,0 +1,569 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+#include "motif_compare.hpp"
+#include "motif_search.hpp"
+#include "output_writer.hpp"
+
+
+namespace {
+  using namespace network_motifs;
+
+  struct Help {};
+
+  //========
+  // Served
+  //========
+  // One graph read at start-up, and its census once someone asks for it
+  struct Served {
+    std::string name;
+    Graph graph;
+    mutable std::once_flag counted;
+    mutable Census census;
+  };
+
+  typedef std::vector< std::unique_ptr<Served> > Graphs;
+
+  //===========
+  // CheckArgs
+  //===========
+  struct CheckArgs {
+    CheckArgs(int argc, char** argv) : threads_(std::max(1u, std::thread::hardware_concurrency())) {
+      for ( int i = 1; i < argc; ++i ) {
+        if ( std::string(argv[i]) == "--help" || std::string(argv[i]) == "-h" )
+          throw(Help());
+      } // for
+
+      for ( int argcntr = 1; argcntr < argc; ++argcntr ) {
+        const std::string next = argv[argcntr];
+        if ( next == "--socket" && argcntr + 1 < argc && socket_.empty() ) {
+          socket_ = argv[++argcntr];
+          if ( socket_.size() >= sizeof(sockaddr_un().sun_path) )
+            throw(Usage() + "\n--socket path is too long: " + socket_);
+        } else if ( next == "--threads" && argcntr + 1 < argc ) {
+          std::stringstream conv(argv[++argcntr]);
+          if ( !(conv >> threads_) || !conv.eof() || threads_ == 0 )
+            throw(Usage() + "\n--threads expects a positive number");
+        } else if ( next.size() > 2 && next.compare(0, 2, "--") == 0 ) {
+          throw(Usage() + "\nUnrecognized option: " + next);
+        } else {
+          // name=file, or a file that is its own name
+          const std::string::size_type eq = next.find('=');
+          const std::string name = (eq == std::string::npos) ? next : next.substr(0, eq);
+          const std::string file = (eq == std::string::npos) ? next : next.substr(eq + 1);
+          if ( name.empty() || file.empty() )
+            throw(Usage() + "\nExpected name=input-graph: " + next);
+          for ( auto& g : graphs_ ) {
+            if ( g.first == name )
+              throw(Usage() + "\nGraph name given twice: " + name);
+          } // for
+          graphs_.push_back(std::make_pair(name, file));
+        }
+      } // for
+      if ( graphs_.empty() )
+        throw(Usage());
+    }
+
+    const std::string& Socket() const { return socket_; }
+    unsigned int Threads() const { return threads_; }
+    const std::vector< std::pair<std::string, std::string> >& GraphFiles() const { return graphs_; }
+
+    static std::string Usage() {
+      std::string msg = "motif_server [--socket <path>] [--threads <N>] <name=input-graph> ...";
+      msg += "\n\n  Reads each <input-graph>, a file of find_3node_motifs input rows, once and then answers";
+      msg += "\n  requests about them, one per line, on stdin or on the Unix domain socket <path>.";
+      msg += "\n  A graph is named by <name>, or by its file name when no name is given.  Fields of a";
+      msg += "\n  request are separated by tabs, or by spaces in a line with no tab:";
+      msg += "\n\n    graphs\n      each graph's name and number of nodes";
+      msg += "\n    census <graph> [[--all-seeds] <label> ...]\n      motif counts as from find_3node_motifs --counts, of the whole graph or only of the\n      motifs holding the labeled nodes, as with --seeds [--all-seeds]";
+      msg += "\n    motifs <graph> [--all-seeds] <label> ...\n      the motifs holding the labeled nodes, as find_3node_motifs --seeds lists them";
+      msg += "\n    classify <target> <reference> <A> <B> <C>\n      the motif the nodes A, B and C form in each graph, then the row that\n      motif3_network_changes --details shows for the reference's motif";
+      msg += "\n    matrix <target> <reference>\n      the count summary of motif3_network_changes for the motifs of both graphs";
+      msg += "\n    quit\n      ends the connection";
+      msg += "\n\n  Every response ends with an empty line; a request that fails gets a row of Error<tab>reason.";
+      msg += "\n  A long motifs listing is sent as it is found, so an Error row can end a listing after some";
+      msg += "\n  of its rows; the rows before it are then an incomplete listing.";
+      msg += "\n  Labels not in a graph are ignored.";
+      msg += "\n\n  --socket <path> listens on <path> instead of reading stdin, replacing any socket there";
+      msg += "\n  --threads <N> serves up to N socket connections at once (default: one per core)";
+      return msg;
+    }
+
+  private:
+    std::string socket_;
+    unsigned int threads_;
+    std::vector< std::pair<std::string, std::string> > graphs_;
+  };
+
+  //============
+  // Connection
+  //============
+  // Request lines from one descriptor and responses to another
+  class Connection {
+  public:
+    Connection(int in, int out) : in_(in), out_(out), failed_(false), at_(0) {}
+
+    // false at the end of input
+    bool ReadLine(std::string& line);
+
+    // Send text, which is left empty; false once a write has failed
+    bool Write(std::string& text);
+
+  private:
+    const int in_, out_;
+    bool failed_;
+    std::string buf_;
+    std::size_t at_; // start of the unread part of buf_
+  };
+
+  // Fwd declarations
+  void read_graphs(const CheckArgs& args, Graphs& graphs);
+  void serve(const Graphs& graphs, Connection& conn);
+  void serve_socket(const CheckArgs& args, const Graphs& graphs);
+} // unnamed
+
+
+//========
+// main()
+//========
+int main(int argc, char** argv) {
+  try {
+    CheckArgs args(argc, argv);
+    std::signal(SIGPIPE, SIG_IGN); // a client that goes away is seen as a failed write
+    Graphs graphs;
+    read_graphs(args, graphs);
+    if ( args.Socket().empty() ) {
+      Connection conn(STDIN_FILENO, STDOUT_FILENO);
+      serve(graphs, conn);
+    } else {
+      serve_socket(args, graphs);
+    }
+    return EXIT_SUCCESS;
+  } catch(Help& h) {
+    std::cout << CheckArgs::Usage() << std::endl;
+    return EXIT_SUCCESS;
+  } catch(std::string& s) {
+    std::cerr << s << std::endl;
+  } catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+  } catch(...) {
+    std::cerr << "Uknown exception" << std::endl;
+  }
+  return EXIT_FAILURE;
+}
+
+
+namespace {
+  //============
+  // Connection
+  //============
+  bool Connection::ReadLine(std::string& line) {
+    while ( true ) {
+      const std::string::size_type eol = buf_.find('\n', at_);
+      if ( eol != std::string::npos ) {
+        line.assign(buf_, at_, eol - at_);
+        at_ = eol + 1;
+        if ( !line.empty() && line.back() == '\r' )
+          line.pop_back();
+        return true;
+      }
+      buf_.erase(0, at_);
+      at_ = 0;
+      char chunk[1 << 16];
+      const ssize_t n = ::read(in_, chunk, sizeof(chunk));
+      if ( n < 0 && errno == EINTR )
+        continue;
+      if ( n <= 0 ) { // a last line without a newline still counts
+        line.swap(buf_);
+        buf_.clear();
+        return !line.empty();
+      }
+      buf_.append(chunk, static_cast<std::size_t>(n));
+    } // while
+  }
+
+  bool Connection::Write(std::string& text) {
+    std::size_t done = 0;
+    while ( !failed_ && done < text.size() ) {
+      const ssize_t n = ::write(out_, text.data() + done, text.size() - done);
+      if ( n < 0 && errno == EINTR )
+        continue;
+      if ( n < 0 )
+        failed_ = true;
+      else
+        done += static_cast<std::size_t>(n);
+    } // while
+    text.clear();
+    return !failed_;
+  }
+
+  //==============
+  // read_graphs()
+  //==============
+  void read_graphs(const CheckArgs& args, Graphs& graphs) {
+    for ( auto& g : args.GraphFiles() ) {
+      graphs.push_back(std::unique_ptr<Served>(new Served));
+      Served& s = *graphs.back();
+      s.name = g.first;
+      MappedFile file(g.second, "input file");
+      s.graph.Read(file);
+      s.graph.BuildHubs(Graph::DefaultHubDegree(s.graph.NumberOfNodes()));
+    } // for
+  }
+
+  //==========
+  // Requests
+  //==========
+  // A request's fields
+  std::vector<std::string> fields(const std::string& line) {
+    const char sep = (line.find('\t') != std::string::npos) ? '\t' : ' ';
+    std::vector<std::string> f;
+    std::string::size_type start = 0;
+    while ( start <= line.size() ) {
+      std::string::size_type end = line.find(sep, start);
+      if ( end == std::string::npos )
+        end = line.size();
+      if ( end > start ) // runs of spaces separate once
+        f.push_back(line.substr(start, end - start));
+      start = end + 1;
+    } // while
+    return f;
+  }
+
+  const Served& find_graph(const Graphs& graphs, const std::string& name) {
+    for ( auto& g : graphs ) {
+      if ( g->name == name )
+        return *g;
+    } // for
+    throw("Unknown graph: " + name);
+  }
+
+  void append_label(std::string& s, const Graph& graph, Node n) {
+    s.append(graph.NodeLabels().Data(n), graph.NodeLabels().Length(n));
+  }
+
+  // The ids of labels f[from] ... in increasing order; those not in graph are left out
+  std::vector<Node> seeds(const Graph& graph, const std::vector<std::string>& f, std::size_t from) {
+    std::vector<Node> ids;
+    Node n;
+    for ( std::size_t i = from; i < f.size(); ++i ) {
+      if ( graph.NodeLabels().Find(f[i].data(), f[i].size(), n) )
+        ids.push_back(n);
+    } // for
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+  }
+
+  // Instances as find_3node_motifs lists them, sent on in pieces
+  struct Lister {
+    void operator()(MotifType type, Node a, Node b, Node c) {
+      text->append(MotifNames[type]);
+      text->append(":\t"); append_label(*text, *graph, a);
+      text->push_back('\t'); append_label(*text, *graph, b);
+      text->push_back('\t'); append_label(*text, *graph, c);
+      text->push_back('\n');
+      if ( text->size() >= (1 << 20) )
+        conn->Write(*text);
+    }
+
+    const Graph* graph;
+    Connection* conn;
+    std::string* text;
+  };
+
+  // census <graph> [[--all-seeds] <label> ...]
+  void census(const Graphs& graphs, const std::vector<std::string>& f, std::string& text) {
+    if ( f.size() < 2 )
+      throw(std::string("census expects a graph name"));
+    const Served& s = find_graph(graphs, f[1]);
+    Census counts(NumberOfMotifTypes, 0);
+    if ( f.size() == 2 ) {
+      std::call_once(s.counted, [&s] { s.census = motif_counts(s.graph); });
+      counts = s.census;
+    } else {
+      const bool all = (f[2] == "--all-seeds");
+      const std::vector<Node> ids = seeds(s.graph, f, all ? 3 : 2);
+      CountOnly count;
+      seeded_pass(s.graph, ids, 0, ids.size(), all, counts, count);
+    }
+    for ( int m = 0; m < NumberOfMotifTypes; ++m ) {
+      text.append(MotifNames[m]);
+      text.push_back('\t');
+      append_number(text, static_cast<long>(counts[m]));
+      text.push_back('\n');
+    } // for
+  }
+
+  // motifs <graph> [--all-seeds] <label> ...  The request is checked in full
+  //  before any row goes out, so only running out of memory can end a
+  //  listing that has begun with an Error row.
+  void motifs(const Graphs& graphs, const std::vector<std::string>& f, Connection& conn, std::string& text) {
+    if ( f.size() < 3 )
+      throw(std::string("motifs expects a graph name and node labels"));
+    const Served& s = find_graph(graphs, f[1]);
+    const bool all = (f[2] == "--all-seeds");
+    const std::vector<Node> ids = seeds(s.graph, f, all ? 3 : 2);
+    Census counts(NumberOfMotifTypes, 0);
+    Lister lister = { &s.graph, &conn, &text };
+    seeded_pass(s.graph, ids, 0, ids.size(), all, counts, lister);
+  }
+
+  // motif3_network_changes' type for one of ours
+  changes::MotifType change_type(int type) {
+    return changes::get_motif(std::string(MotifNames[type]) + ":");
+  }
+
+  // The motif of labels ref in graph, or changes::NoMatch; listed gets its
+  //  labels in listed order
+  changes::MotifType classify(const Graph& graph, const std::string* const ref[3], std::string listed[3]) {
+    Node n[3], order[3];
+    for ( int i = 0; i < 3; ++i ) {
+      if ( !graph.NodeLabels().Find(ref[i]->data(), ref[i]->size(), n[i]) )
+        return changes::NoMatch;
+    } // for
+    const int type = classify_triple(graph, n[0], n[1], n[2], order);
+    if ( type == triads::NotConnected )
+      return changes::NoMatch;
+    for ( int i = 0; i < 3; ++i )
+      listed[i].assign(graph.NodeLabels().Data(order[i]), graph.NodeLabels().Length(order[i]));
+    return change_type(type);
+  }
+
+  // classify <target> <reference> <A> <B> <C>
+  void classify(const Graphs& graphs, const std::vector<std::string>& f, std::string& text) {
+    if ( f.size() != 6 )
+      throw(std::string("classify expects a target and a reference graph and 3 node labels"));
+    if ( f[3] == f[4] || f[3] == f[5] || f[4] == f[5] )
+      throw(std::string("classify expects 3 different node labels"));
+    const Served* served[2] = { &find_graph(graphs, f[1]), &find_graph(graphs, f[2]) };
+    const std::string* const nodes[3] = { &f[3], &f[4], &f[5] };
+    std::string listed[2][3];
+    changes::MotifType types[2];
+    for ( int g = 0; g < 2; ++g ) {
+      types[g] = classify(served[g]->graph, nodes, listed[g]);
+      text.append(served[g]->name);
+      if ( types[g] == changes::NoMatch )
+        text.append("\tNo-Match\n");
+      else {
+        text.push_back('\t');
+        text.append(changes::get_name(types[g]));
+        text.push_back(':');
+        for ( int i = 0; i < 3; ++i )
+          text.append("\t" + listed[g][i]);
+        text.push_back('\n');
+      }
+    } // for
+
+    // the reference's motif as motif3_network_changes --details shows it
+    if ( types[1] != changes::NoMatch ) {
+      const std::string* const ref[3] = { &listed[1][0], &listed[1][1], &listed[1][2] };
+      const std::string* const trg[3] = { &listed[0][0], &listed[0][1], &listed[0][2] };
+      changes::Counts counts;
+      changes::init_counts(counts);
+      std::ostringstream details;
+      changes::map_motif(types[1], ref, types[0], trg, counts, &details);
+      text.append(details.str());
+    }
+  }
+
+  // Maps each motif of a reference graph onto the target, by the nodes'
+  //  labels, into counts as motif3_network_changes does
+  struct Mapper {
+    Mapper(const Graph& target, const Graph& reference, changes::Counts& counts)
+      : target_(target), reference_(reference), counts_(counts), ids_(reference.NumberOfNodes()) {
+      for ( Node n = 0; n < reference.NumberOfNodes(); ++n ) {
+        if ( !target.NodeLabels().Find(reference.NodeLabels().Data(n), reference.NodeLabels().Length(n), ids_[n]) )
+          ids_[n] = Missing;
+      } // for
+      for ( int m = 0; m < NumberOfMotifTypes; ++m )
+        types_[m] = change_type(m);
+    }
+
+    void operator()(MotifType type, Node a, Node b, Node c) {
+      const Node n[3] = { a, b, c };
+      for ( int i = 0; i < 3; ++i )
+        refLabels_[i].assign(reference_.NodeLabels().Data(n[i]), reference_.NodeLabels().Length(n[i]));
+      const std::string* const ref[3] = { &refLabels_[0], &refLabels_[1], &refLabels_[2] };
+      const std::string* const trg[3] = { &trgLabels_[0], &trgLabels_[1], &trgLabels_[2] };
+
+      int trgType = triads::NotConnected;
+      if ( ids_[a] != Missing && ids_[b] != Missing && ids_[c] != Missing ) {
+        Node order[3];
+        trgType = classify_triple(target_, ids_[a], ids_[b], ids_[c], order);
+        if ( trgType != triads::NotConnected ) {
+          for ( int i = 0; i < 3; ++i )
+            trgLabels_[i].assign(target_.NodeLabels().Data(order[i]), target_.NodeLabels().Length(order[i]));
+        }
+      }
+      changes::map_motif(types_[type], ref,
+                         (trgType == triads::NotConnected) ? changes::NoMatch : types_[trgType], trg,
+                         counts_, static_cast<std::ostream*>(nullptr));
+    }
+
+  private:
+    static const Node Missing = ~Node(0);
+
+    const Graph& target_;
+    const Graph& reference_;
+    changes::Counts& counts_;
+    std::vector<Node> ids_; // the target's id of each reference node
+    changes::MotifType types_[NumberOfMotifTypes];
+    std::string refLabels_[3], trgLabels_[3];
+  };
+
+  // matrix <target> <reference>
+  void matrix(const Graphs& graphs, const std::vector<std::string>& f, std::string& text) {
+    if ( f.size() != 3 )
+      throw(std::string("matrix expects a target and a reference graph"));
+    const Served& target = find_graph(graphs, f[1]);
+    const Served& reference = find_graph(graphs, f[2]);
+    changes::Counts counts;
+    changes::init_counts(counts);
+    Mapper mapper(target.graph, reference.graph, counts);
+    for ( int m = 0; m < NumberOfMotifTypes; ++m )
+      find_instances(reference.graph, static_cast<MotifType>(m), 0, reference.graph.NumberOfNodes(), mapper);
+
+    std::ostringstream out;
+    changes::matrix_header(out);
+    changes::matrix_rows(counts, out, "");
+    text.append(out.str());
+  }
+
+  //=========
+  // serve()
+  //=========
+  // Answer requests on conn until it ends or asks to quit
+  void serve(const Graphs& graphs, Connection& conn) {
+    std::string line, text;
+    while ( conn.ReadLine(line) ) {
+      const std::vector<std::string> f = fields(line);
+      if ( f.empty() )
+        continue;
+      if ( f[0] == "quit" )
+        break;
+      try {
+        if ( f[0] == "graphs" ) {
+          for ( auto& g : graphs ) {
+            text.append(g->name + "\t");
+            append_number(text, static_cast<long>(g->graph.NumberOfNodes()));
+            text.push_back('\n');
+          } // for
+        } else if ( f[0] == "census" )
+          census(graphs, f, text);
+        else if ( f[0] == "motifs" )
+          motifs(graphs, f, conn, text);
+        else if ( f[0] == "classify" )
+          classify(graphs, f, text);
+        else if ( f[0] == "matrix" )
+          matrix(graphs, f, text);
+        else
+          throw("Unknown request: " + f[0]);
+      } catch(std::string& s) {
+        text = "Error\t" + s + "\n";
+      } catch(std::exception& e) {
+        text = "Error\t" + std::string(e.what()) + "\n";
+      }
+      text.push_back('\n');
+      if ( !conn.Write(text) )
+        break;
+    } // while
+  }
+
+  //================
+  // serve_socket()
+  //================
+  // Each of a pool of workers takes connections on the socket in turn, so
+  //  that up to args.Threads() clients are served at once from the same graphs.
+  //  A worker that is out of descriptors or memory waits for some to be freed;
+  //  any other failure to accept stops the server.
+  char socketPath[sizeof(sockaddr_un().sun_path)];
+
+  void remove_socket(int sig) {
+    ::unlink(socketPath);
+    std::_Exit(128 + sig);
+  }
+
+  void serve_socket(const CheckArgs& args, const Graphs& graphs) {
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( listener < 0 )
+      throw(std::string("Unable to create a socket"));
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, args.Socket().c_str());
+    struct stat st;
+    if ( ::lstat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode) ) // left by an earlier server
+      ::unlink(addr.sun_path);
+    if ( ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listener, 64) != 0 )
+      throw("Unable to listen on socket: " + args.Socket());
+    std::strcpy(socketPath, addr.sun_path);
+    std::signal(SIGINT, remove_socket);
+    std::signal(SIGTERM, remove_socket);
+    std::cerr << "Serving " << graphs.size() << " graph" << (graphs.size() > 1 ? "s" : "")
+              << " on " << args.Socket() << std::endl;
+
+    std::vector<std::thread> workers;
+    std::mutex failureLock;
+    int failure = 0; // errno of an accept that cannot be retried
+    for ( unsigned int w = 0; w < args.Threads(); ++w ) {
+      workers.push_back(std::thread([&] {
+        bool waiting = false;
+        while ( true ) {
+          const int fd = ::accept(listener, nullptr, nullptr);
+          if ( fd < 0 ) {
+            const int err = errno;
+            if ( err == EINTR || err == ECONNABORTED ) // a client that gave up
+              continue;
+            std::unique_lock<std::mutex> lock(failureLock);
+            if ( failure ) // another worker has stopped the server
+              return;
+            if ( err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM ) {
+              if ( !waiting )
+                std::cerr << "Unable to accept a connection (" << std::strerror(err) << "); waiting" << std::endl;
+              lock.unlock();
+              waiting = true;
+              std::this_thread::sleep_for(std::chrono::milliseconds(100));
+              continue;
+            }
+            failure = err;
+            ::shutdown(listener, SHUT_RDWR); // wakes workers waiting in accept()
+            return;
+          }
+          waiting = false;
+          Connection conn(fd, fd);
+          serve(graphs, conn);
+          ::close(fd);
+        } // while
+      }));
+    } // for
+    for ( auto& w : workers )
+      w.join();
+    ::unlink(socketPath);
+    throw("Unable to accept connections on socket: " + args.Socket() + ": " + std::strerror(failure));
+  }
+
+} // unnamed
@@ -0,0 +1,183 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#ifndef NETWORK_MOTIFS_OUTPUT_WRITER_HPP
+#define NETWORK_MOTIFS_OUTPUT_WRITER_HPP
+
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace network_motifs {
+
+  //==============
+  // OutputWriter
+  //==============
+  // Writes buffers to a file descriptor from a thread of its own, so callers
+  //  only wait on a slow reader once Limit bytes are queued.  Buffers are taken
+  //  by swap rather than copied, and emptied ones come back with their capacity
+  //  for reuse.  Whatever is queued when the writer wakes goes out in one
+  //  writev(2).
+  class OutputWriter {
+  public:
+    static const std::size_t Limit = std::size_t(1) << 26;
+
+    explicit OutputWriter(int fd = STDOUT_FILENO);
+    ~OutputWriter();
+
+    // Queue the contents of buf; buf is left empty, with spare capacity if
+    //  an earlier buffer has been written out by then
+    void Write(std::string& buf);
+
+    // Wait for everything queued to be written; throws if a write failed
+    void Finish();
+
+  private:
+    OutputWriter(const OutputWriter&); // not copyable
+    OutputWriter& operator=(const OutputWriter&);
+
+    void run();
+    bool write_all(std::vector<std::string>& bufs);
+
+    const int fd_;
+    std::size_t queued_; // bytes
+    std::deque<std::string> queue_;
+    std::vector<std::string> spare_;
+    bool done_, failed_;
+    std::mutex lock_;
+    std::condition_variable ready_, drained_;
+    std::thread thread_;
+  };
+
+  inline OutputWriter::OutputWriter(int fd) : fd_(fd), queued_(0), done_(false), failed_(false) {
+    thread_ = std::thread([this] { run(); });
+  }
+
+  inline OutputWriter::~OutputWriter() {
+    try {
+      Finish();
+    } catch(...) {
+    }
+  }
+
+  inline void OutputWriter::Write(std::string& buf) {
+    if ( buf.empty() )
+      return;
+    std::unique_lock<std::mutex> lock(lock_);
+    drained_.wait(lock, [this] { return queued_ < Limit || failed_; });
+    if ( failed_ ) { // reported by Finish()
+      buf.clear();
+      return;
+    }
+    queued_ += buf.size();
+    queue_.push_back(std::string());
+    queue_.back().swap(buf);
+    if ( !spare_.empty() ) {
+      buf.swap(spare_.back());
+      spare_.pop_back();
+    }
+    ready_.notify_one();
+  }
+
+  inline void OutputWriter::Finish() {
+    if ( !thread_.joinable() )
+      return;
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      done_ = true;
+      ready_.notify_one();
+    }
+    thread_.join();
+    if ( failed_ )
+      throw(std::string("Unable to write output"));
+  }
+
+  inline void OutputWriter::run() {
+    std::vector<std::string> bufs;
+    while ( true ) {
+      {
+        std::unique_lock<std::mutex> lock(lock_);
+        for ( auto& b : bufs ) { // written last time around
+          queued_ -= b.size();
+          b.clear();
+          if ( spare_.size() < 16 ) {
+            spare_.push_back(std::string());
+            spare_.back().swap(b);
+          }
+        } // for
+        bufs.clear();
+        drained_.notify_all();
+
+        ready_.wait(lock, [this] { return !queue_.empty() || done_; });
+        if ( queue_.empty() )
+          return;
+        while ( !queue_.empty() && bufs.size() < IOV_MAX ) {
+          bufs.push_back(std::string());
+          bufs.back().swap(queue_.front());
+          queue_.pop_front();
+        } // while
+      }
+
+      if ( !failed_ && !write_all(bufs) ) {
+        std::lock_guard<std::mutex> guard(lock_);
+        failed_ = true;
+      }
+    } // while
+  }
+
+  inline bool OutputWriter::write_all(std::vector<std::string>& bufs) {
+    std::vector<iovec> iov(bufs.size());
+    for ( std::size_t i = 0; i < bufs.size(); ++i ) {
+      iov[i].iov_base = const_cast<char*>(bufs[i].data());
+      iov[i].iov_len = bufs[i].size();
+    } // for
+
+    std::size_t first = 0;
+    while ( first < iov.size() ) {
+      const ssize_t n = ::writev(fd_, &iov[first], static_cast<int>(iov.size() - first));
+      if ( n < 0 ) {
+        if ( errno == EINTR )
+          continue;
+        return false;
+      }
+      std::size_t done = static_cast<std::size_t>(n);
+      while ( first < iov.size() && done >= iov[first].iov_len )
+        done -= iov[first++].iov_len;
+      if ( first < iov.size() ) { // partly written
+        iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + done;
+        iov[first].iov_len -= done;
+      }
+    } // while
+    return true;
+  }
+
+  //===============
+  // append_number
+  //===============
+  // Decimal text of v, without going through a stream or printf
+  inline void append_number(std::string& s, long v) {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    unsigned long u = (v < 0) ? 0UL - static_cast<unsigned long>(v) : static_cast<unsigned long>(v);
+    do {
+      *--p = static_cast<char>('0' + u % 10);
+      u /= 10;
+    } while ( u );
+    if ( v < 0 )
+      *--p = '-';
+    s.append(p, digits + sizeof(digits));
+  }
+
+} // namespace network_motifs
+
+#endif // NETWORK_MOTIFS_OUTPUT_WRITER_HPP
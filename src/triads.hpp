@@ -0,0 +1,133 @@
+/*
+  Author: Shane J. Neph
+*/
+
+#ifndef NETWORK_MOTIFS_TRIADS_HPP
+#define NETWORK_MOTIFS_TRIADS_HPP
+
+#include <cstdint>
+
+#include "motif_instances.hpp"
+
+namespace network_motifs {
+namespace triads {
+
+  //========
+  // Triads
+  //========
+  // How find_3node_motifs classifies a triple of nodes and orders them for
+  //  output, shared with motif3_network_changes so that both agree.
+
+  // Type codes of InstanceTypeNames; NotConnected for a triple that is no motif
+  enum Type {
+    FFL = 0, TreLoop, TreChain, Vout, Vin, RegulatingMutual, RegulatedMutual,
+    Clique, SemiClique, MutualAnd3Chain, MutualV, MutualOut, MutualIn,
+    NotConnected
+  };
+  static_assert(NotConnected == NumberOfInstanceTypes, "triad types and instance codes differ");
+
+  // The six possible directed edges among the nodes 0 < 1 < 2 of a triple make
+  //  a 6-bit code.  TriadTable maps every code, at compile time, to its motif
+  //  type and to the order in which find_3node_motifs prints the three nodes.
+
+  constexpr int edge_bit(int x, int y) {
+    return x == 0 ? (y == 1 ? 0 : 2) : (x == 1 ? (y == 0 ? 1 : 4) : (y == 0 ? 3 : 5));
+  }
+  constexpr bool has_edge(int code, int x, int y) { return ((code >> edge_bit(x, y)) & 1) != 0; }
+  constexpr bool uni(int code, int x, int y) { return has_edge(code, x, y) && !has_edge(code, y, x); }
+  constexpr bool mutual(int code, int x, int y) { return has_edge(code, x, y) && has_edge(code, y, x); }
+  constexpr bool joined(int code, int x, int y) { return has_edge(code, x, y) || has_edge(code, y, x); }
+
+  constexpr int uni_out(int code, int x) { return uni(code, x, (x+1)%3) + uni(code, x, (x+2)%3); }
+  constexpr int uni_in(int code, int x) { return uni(code, (x+1)%3, x) + uni(code, (x+2)%3, x); }
+  constexpr int mutuals(int code, int x) { return mutual(code, x, (x+1)%3) + mutual(code, x, (x+2)%3); }
+  constexpr int joined_pairs(int code) { return joined(code, 0, 1) + joined(code, 0, 2) + joined(code, 1, 2); }
+  constexpr int mutual_pairs(int code) { return mutual(code, 0, 1) + mutual(code, 0, 2) + mutual(code, 1, 2); }
+
+  constexpr bool any_node(int code, int uo, int ui, int m) {
+    return (uni_out(code, 0) == uo && uni_in(code, 0) == ui && mutuals(code, 0) == m)
+        || (uni_out(code, 1) == uo && uni_in(code, 1) == ui && mutuals(code, 1) == m)
+        || (uni_out(code, 2) == uo && uni_in(code, 2) == ui && mutuals(code, 2) == m);
+  }
+
+  // NotConnected when the triple is not connected
+  constexpr int triad_type(int code) {
+    return joined_pairs(code) < 2 ? NotConnected
+         : mutual_pairs(code) == 3 ? Clique
+         : mutual_pairs(code) == 2 ? (joined_pairs(code) == 3 ? SemiClique : MutualV)
+         : mutual_pairs(code) == 1 ? (joined_pairs(code) == 2 ? (any_node(code, 1, 0, 1) ? MutualOut : MutualIn)
+                                   : any_node(code, 0, 2, 0) ? RegulatingMutual
+                                   : any_node(code, 2, 0, 0) ? RegulatedMutual
+                                   : MutualAnd3Chain)
+         : joined_pairs(code) == 2 ? (any_node(code, 2, 0, 0) ? Vout : any_node(code, 0, 2, 0) ? Vin : TreChain)
+         : (any_node(code, 2, 0, 0) ? FFL : TreLoop);
+  }
+
+  // Where node x is printed among nodes of the same rank, ties go by id.  These
+  //  follow the print statements of the motif functions in find_3node_motifs.
+  constexpr int role_rank(int type, int code, int x) {
+    return type == FFL ? (uni_out(code, x) == 2 ? 0 : uni_in(code, x) == 2 ? 2 : 1)
+         : type == TreLoop ? (uni(code, x, 0) ? 0 : x == 0 ? 1 : 2) // the smallest node goes 2nd
+         : type == TreChain ? (uni_in(code, x) == 0 ? 0 : uni_out(code, x) == 0 ? 2 : 1)
+         : type == Vout ? (uni_out(code, x) == 2 ? 0 : 1)
+         : type == Vin ? (uni_in(code, x) == 2 ? 0 : 1)
+         : type == RegulatingMutual ? (uni_in(code, x) == 2 ? 0 : 1)
+         : type == RegulatedMutual ? (uni_out(code, x) == 2 ? 0 : 1)
+         : type == SemiClique ? (mutuals(code, x) == 2 ? 0 : uni_out(code, x) == 1 ? 1 : 2)
+         : type == MutualAnd3Chain ? (mutuals(code, x) == 0 ? 1 : uni_out(code, x) == 1 ? 0 : 2)
+         : type == MutualV ? (mutuals(code, x) == 2 ? 0 : 1)
+         : type == MutualOut ? (mutuals(code, x) == 0 ? 2 : uni_out(code, x) == 1 ? 0 : 1)
+         : type == MutualIn ? (mutuals(code, x) == 0 ? 2 : uni_in(code, x) == 1 ? 0 : 1)
+         : 0;
+  }
+
+  constexpr int position(int code, int x) {
+    return (role_rank(triad_type(code), code, (x+1)%3) * 3 + (x+1)%3 < role_rank(triad_type(code), code, x) * 3 + x)
+         + (role_rank(triad_type(code), code, (x+2)%3) * 3 + (x+2)%3 < role_rank(triad_type(code), code, x) * 3 + x);
+  }
+
+  constexpr int printed(int code, int pos) {
+    return position(code, 0) == pos ? 0 : position(code, 1) == pos ? 1 : 2;
+  }
+
+  struct Triad {
+    std::uint8_t type;
+    std::uint8_t order[3]; // order[i] is the node printed i-th
+  };
+
+  constexpr Triad make_triad(int code) {
+    return Triad{ static_cast<std::uint8_t>(triad_type(code)),
+                  { static_cast<std::uint8_t>(printed(code, 0)),
+                    static_cast<std::uint8_t>(printed(code, 1)),
+                    static_cast<std::uint8_t>(printed(code, 2)) } };
+  }
+
+  template <int... Codes> struct CodeList {};
+  template <int N, int... Codes> struct MakeCodeList : MakeCodeList<N-1, N-1, Codes...> {};
+  template <int... Codes> struct MakeCodeList<0, Codes...> { typedef CodeList<Codes...> type; };
+
+  struct TriadTable {
+    Triad entries[64];
+  };
+
+  template <int... Codes>
+  constexpr TriadTable make_triad_table(CodeList<Codes...>) {
+    return TriadTable{ { make_triad(Codes)... } };
+  }
+
+  constexpr TriadTable triadTable = make_triad_table(MakeCodeList<64>::type());
+
+  static_assert(triad_type(0) == NotConnected && triad_type(63) == Clique, "triad table");
+
+  // Code of the triple x < y < z, from how each lower node is joined to each
+  //  higher one: bit 1 set for lower->higher, bit 2 for higher->lower
+  inline int triad_code(unsigned int xy, unsigned int xz, unsigned int yz) {
+    return static_cast<int>(((xy & 1) << edge_bit(0, 1)) | ((xy >> 1) << edge_bit(1, 0))
+                          | ((xz & 1) << edge_bit(0, 2)) | ((xz >> 1) << edge_bit(2, 0))
+                          | ((yz & 1) << edge_bit(1, 2)) | ((yz >> 1) << edge_bit(2, 1)));
+  }
+
+} // namespace triads
+} // namespace network_motifs
+
+#endif // NETWORK_MOTIFS_TRIADS_HPP